@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "debug_info.hh"
+#include "object_index.hh"
+#include "shared_object.hh"
+#include "trace_file.hh"
+
+using std::unordered_map;
+using std::vector;
+
+// Lookups timed per method, at least. Short traces are replayed until then.
+#define MIN_LOOKUPS 10000000
+
+// An instruction of the trace
+struct sample {
+  size_t thread; // Dense index of the executing thread, for its hint
+  intptr_t ip;   // Instruction address
+};
+
+/**
+* Reads a trace's instructions, and every object mapped while it ran. An
+*   object mapped over the range of an earlier one is left out, so that
+*   every address belongs to at most one object.
+* @param reader   the trace
+* @param mappings set to the mapped objects, sorted by address
+* @param samples  a vector to append the instructions to
+*/
+void read_trace(trace_reader &reader, vector<trace_mapping> &mappings, vector<sample> &samples) {
+  vector<trace_mapping> all = reader.get_mappings();
+  unordered_map<pid_t, size_t> threads;
+  trace_record rec;
+  while (reader.next(rec)) {
+    if (rec.type == trace_record::MAP) {
+      all.push_back(reader.get_mapping());
+    } else if (rec.type == trace_record::INSTRUCTION) {
+      size_t thread = threads.emplace(rec.tid, threads.size()).first->second;
+      samples.push_back(sample{thread, (intptr_t)rec.ip});
+    }
+  }
+
+  std::stable_sort(all.begin(), all.end(),
+                   [](const trace_mapping &a, const trace_mapping &b) { return a.start < b.start; });
+  for (auto &mapping : all) {
+    if (mappings.empty() || mapping.start >= mappings.back().end) {
+      mappings.push_back(mapping);
+    }
+  }
+}
+
+/**
+* @return the current time of the monotonic clock, in seconds
+*/
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+  /* Parse command line arguments */
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <binary trace file>\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  vector<trace_mapping> mappings;
+  vector<sample> samples;
+  try {
+    trace_reader reader {argv[1]};
+    read_trace(reader, mappings, samples);
+  } catch(std::invalid_argument &e) {
+    fprintf(stderr, "%s\n", e.what());
+    exit(EXIT_FAILURE);
+  } catch(std::runtime_error &e) {
+    fprintf(stderr, "Corrupt trace: %s\n", e.what());
+    exit(EXIT_FAILURE);
+  }
+  if (samples.empty()) {
+    fprintf(stderr, "No instructions in '%s'\n", argv[1]);
+    exit(EXIT_FAILURE);
+  }
+
+  /* Both methods search the same objects. Only the ELF headers of the
+     files are read. */
+  vector<shared_obj> objects;
+  debug_info_cache debug_infos;
+  for (auto &mapping : mappings) {
+    auto info = debug_infos.get(mapping.path, 0, 0);
+    if (info) {
+      objects.push_back(shared_obj (info, mapping.start, mapping.end, mapping.offset));
+    }
+  }
+  object_index index;
+  index.build(objects);
+
+  size_t rounds = std::max<size_t>(1, MIN_LOOKUPS / samples.size());
+  size_t lookups = rounds * samples.size();
+  printf("%zu objects, %zu instructions, %zu lookups per method\n",
+         objects.size(), samples.size(), lookups);
+
+  /* The stepping loop before the index: a scan of every object, copying
+     each one */
+  unsigned long linear_found = 0;
+  double start = now();
+  for (size_t r = 0; r < rounds; r++) {
+    for (auto &s : samples) {
+      for (auto obj : objects) {
+        if (obj.contains(s.ip)) {
+          linear_found++;
+          break;
+        }
+      }
+    }
+  }
+  double linear_time = now() - start;
+
+  /* The index, with a hint per thread as the debugger keeps */
+  size_t num_threads = 0;
+  for (auto &s : samples) {
+    num_threads = std::max(num_threads, s.thread + 1);
+  }
+  vector<size_t> hints(num_threads, 0);
+  unsigned long indexed_found = 0;
+  start = now();
+  for (size_t r = 0; r < rounds; r++) {
+    for (auto &s : samples) {
+      if (index.find(s.ip, hints[s.thread]) != nullptr) {
+        indexed_found++;
+      }
+    }
+  }
+  double indexed_time = now() - start;
+
+  printf("%-8s %.3f s, %.0f lookups/s\n", "linear", linear_time, lookups / linear_time);
+  printf("%-8s %.3f s, %.0f lookups/s\n", "indexed", indexed_time, lookups / indexed_time);
+  if (linear_found != indexed_found) {
+    fprintf(stderr, "The methods disagree: %lu and %lu addresses found\n", linear_found,
+            indexed_found);
+    exit(EXIT_FAILURE);
+  }
+  return 0;
+}
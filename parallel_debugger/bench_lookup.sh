@@ -0,0 +1,32 @@
+#!/bin/sh
+# Compares the object lookup of the stepping loop with and without the
+#   address index, on the instructions the test_* programs execute. Each
+#   program is recorded with --binary-trace, then bench_lookup times a
+#   linear scan of the objects and object_index::find over the same
+#   objects and instructions. Build the debugger, bench_lookup and the test
+#   programs with make first.
+#
+# Usage: ./bench_lookup.sh
+
+cd "$(dirname "$0")"
+
+bench=../bench_lookup/bench_lookup
+if [ ! -x "$bench" ]; then
+  echo "Run make in ../bench_lookup first"
+  exit 1
+fi
+trace=$(mktemp)
+trap 'rm -f "$trace"' EXIT
+
+for dir in ../test_*; do
+  prog="$dir/testing"
+  if [ ! -x "$prog" ]; then
+    echo "Skipping $dir: run make there first"
+    continue
+  fi
+  # A deadlocked run is cut short, and its trace kept up to there
+  timeout 120 ./parallel_debugger --binary-trace="$trace" "$(realpath "$prog")" \
+    >/dev/null 2>&1
+  echo "$(basename "$dir"):"
+  "$bench" "$trace" | sed 's/^/  /'
+done
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Compares the ptrace calls spent reading registers per stop for each
+#   --regs strategy, by tracing the test_* programs to completion.
+#   Build the debugger and the test programs with make first.
+#
+# Usage: ./bench_regs.sh [debugger options...]   e.g. ./bench_regs.sh --next
+
+cd "$(dirname "$0")"
+
+for dir in ../test_*; do
+  prog="$dir/testing"
+  if [ ! -x "$prog" ]; then
+    echo "Skipping $dir: run make there first"
+    continue
+  fi
+  for strategy in getregs peekuser regset; do
+    # The summary is the last two lines of standard error; a deadlocked run
+    #   is cut short and reports nothing
+    summary=$(timeout 120 ./parallel_debugger "$@" --trace=/dev/null --regs=$strategy \
+              "$(realpath "$prog")" 2>&1 >/dev/null | tail -n 2 | tr '\n' ' ')
+    printf '%-28s %-9s %s\n' "$(basename "$dir")" "$strategy" "$summary"
+  done
+done
@@ -0,0 +1,291 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "breakpoint_manager.hh"
+
+// 0xcc is the 'send SIGTRAP' instruction
+#define INT3 0xcc
+
+/**
+* construct a new breakpoint manager
+* @param pid the traced process
+* @throws    std::runtime_error if the process' memory cannot be opened
+*/
+breakpoint_manager::breakpoint_manager(pid_t pid)
+: pid{pid}, enabled_count{0} {
+  // The file keeps a reference to the address space, so it remains usable
+  //   after the thread it was opened through exits
+  std::string path = "/proc/" + std::to_string(pid) + "/mem";
+  mem_fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (mem_fd == -1) {
+    throw std::runtime_error{"Cannot open " + path};
+  }
+}
+
+breakpoint_manager::~breakpoint_manager() {
+  close(mem_fd);
+}
+
+/**
+* insert a breakpoint, or share an existing one. Takes effect at the next
+*   flush().
+* @param addr the breakpoint address
+*/
+void breakpoint_manager::insert(intptr_t addr) {
+  site &s = sites[addr];
+  if (s.uses++ == 0) {
+    pending.push_back(addr);
+  }
+}
+
+/**
+* release a breakpoint, removing it once it has no users. Takes effect at
+*   the next flush().
+* @param addr the breakpoint address
+*/
+void breakpoint_manager::remove(intptr_t addr) {
+  auto it = sites.find(addr);
+  if (it == sites.end() || it->second.uses == 0) {
+    return;
+  }
+  if (--it->second.uses == 0) {
+    pending.push_back(addr);
+  }
+}
+
+/**
+* apply the queued insertions and removals to the process' memory
+*/
+void breakpoint_manager::flush() {
+  if (pending.empty()) {
+    return;
+  }
+  std::sort(pending.begin(), pending.end());
+  pending.erase(std::unique(pending.begin(), pending.end()), pending.end());
+
+  // Only patch the sites whose state changed; a breakpoint removed and
+  //   inserted again before the flush stays as it is
+  std::vector<intptr_t> changed;
+  for (auto addr : pending) {
+    auto it = sites.find(addr);
+    if (it == sites.end()) {
+      continue;
+    }
+    if ((it->second.uses > 0) != it->second.enabled) {
+      changed.push_back(addr);
+    }
+  }
+  pending.clear();
+  patch(changed);
+
+  // Forget the sites that were removed, but keep their addresses: other
+  //   threads may already have trapped on them
+  for (auto addr : changed) {
+    auto it = sites.find(addr);
+    if (it->second.uses == 0 && !it->second.enabled) {
+      sites.erase(it);
+      removed.insert(addr);
+    }
+  }
+}
+
+/**
+* check whether a breakpoint instruction is in memory at an address
+* @param  addr the address to check
+* @return      true if a breakpoint is inserted at addr, false otherwise
+*/
+bool breakpoint_manager::contains(intptr_t addr) const {
+  auto it = sites.find(addr);
+  return it != sites.end() && it->second.enabled;
+}
+
+/**
+* check whether a SIGTRAP stop of a thread comes from a breakpoint
+*   instruction at an address. Breakpoints removed since the thread
+*   trapped still count, since another thread may have released them
+*   while the stop was queued.
+* @param  tid  the stopped thread
+* @param  addr the address before the thread's instruction pointer
+* @return      true if the thread executed a breakpoint at addr, false
+*              otherwise
+*/
+bool breakpoint_manager::is_breakpoint_stop(pid_t tid, intptr_t addr) const {
+  if (!contains(addr) && !removed.count(addr)) {
+    return false;
+  }
+  // Only a breakpoint instruction is reported with SI_KERNEL. A single-step
+  //   can also end just after a breakpoint address.
+  siginfo_t info;
+  if (ptrace(PTRACE_GETSIGINFO, tid, NULL, &info) == -1) {
+    return false;
+  }
+  return info.si_signo == SIGTRAP && info.si_code == SI_KERNEL;
+}
+
+/**
+* execute the original instruction under a breakpoint, leaving the
+*   breakpoint in place. The thread is stopped again afterwards. Signals
+*   that arrive during the step are sent to the thread again, to be
+*   reported at its next stop, except for a fault of the instruction
+*   itself, which is delivered in place.
+* @param  tid  a thread stopped at the breakpoint address
+* @param  addr the breakpoint address
+* @return      true if the thread is still stopped, false if it exited
+*/
+bool breakpoint_manager::step_over(pid_t tid, intptr_t addr) {
+  auto it = sites.find(addr);
+  if (it == sites.end() || !it->second.enabled) {
+    return true;
+  }
+
+  // Other threads may run past the breakpoint while it is removed
+  uint8_t int3 = INT3;
+  pwrite(mem_fd, &it->second.saved_data, 1, addr);
+
+  // The step ends with a SIGTRAP. A signal can be reported first, before
+  //   the instruction runs, and ptrace events from a system call.
+  std::vector<int> deferred;
+  int status;
+  int sig = 0;
+  bool stopped = true;
+  while (true) {
+    ptrace(PTRACE_SINGLESTEP, tid, NULL, sig);
+    sig = 0;
+    if (waitpid(tid, &status, __WALL) == -1 || !WIFSTOPPED(status)) {
+      stopped = false;
+      break;
+    }
+    int stop_sig = WSTOPSIG(status);
+    if (stop_sig == SIGTRAP && (status >> 16) == 0) {
+      break;
+    }
+    if (stop_sig == SIGTRAP) {
+      // A ptrace event: let the system call finish
+      continue;
+    }
+
+    // A fault of the instruction would happen again at each step
+    siginfo_t info;
+    bool fault = (stop_sig == SIGSEGV || stop_sig == SIGBUS || stop_sig == SIGILL
+                  || stop_sig == SIGFPE)
+                 && ptrace(PTRACE_GETSIGINFO, tid, NULL, &info) != -1 && info.si_code > 0;
+    if (fault) {
+      sig = stop_sig;
+    } else if (std::find(deferred.begin(), deferred.end(), stop_sig) == deferred.end()) {
+      deferred.push_back(stop_sig);
+    }
+  }
+
+  // Memory is patched through the process, so this works even if the
+  //   thread is gone
+  pwrite(mem_fd, &int3, 1, addr);
+
+  // Queue the signals again; the thread reports them once it is resumed
+  for (size_t i = 0; stopped && i < deferred.size(); i++) {
+    syscall(SYS_tgkill, pid, tid, deferred[i]);
+  }
+  return stopped;
+}
+
+/**
+* write the breakpoint instruction, or the original data, at a set of sites
+* @param addrs the addresses of the sites to patch, sorted
+*/
+void breakpoint_manager::patch(const std::vector<intptr_t> &addrs) {
+  if (addrs.empty()) {
+    return;
+  }
+  static const intptr_t page_size = sysconf(_SC_PAGESIZE);
+
+  // Pages holding the sites, in order
+  std::vector<intptr_t> pages;
+  for (auto addr : addrs) {
+    intptr_t page = addr & ~(page_size - 1);
+    if (pages.empty() || pages.back() != page) {
+      pages.push_back(page);
+    }
+  }
+
+  // Read every page at once, IOV_MAX pages per call
+  std::vector<uint8_t> buf(pages.size() * page_size);
+  std::vector<bool> read_ok(pages.size(), false);
+  std::vector<struct iovec> remote;
+  for (size_t first = 0; first < pages.size(); first += IOV_MAX) {
+    size_t count = std::min(pages.size() - first, (size_t)IOV_MAX);
+    remote.clear();
+    for (size_t i = first; i < first + count; i++) {
+      remote.push_back({reinterpret_cast<void*>(pages[i]), (size_t)page_size});
+    }
+    struct iovec local = {&buf[first * page_size], count * page_size};
+    ssize_t n = process_vm_readv(pid, &local, 1, remote.data(), remote.size(), 0);
+    for (size_t i = 0; n > 0 && i < count && (ssize_t)((i + 1) * page_size) <= n; i++) {
+      read_ok[first + i] = true;
+    }
+  }
+
+  // process_vm_readv fails on pages that are not readable, such as
+  //   execute-only code; /proc/<pid>/mem can still read them
+  for (size_t i = 0; i < pages.size(); i++) {
+    if (!read_ok[i]) {
+      read_ok[i] = pread(mem_fd, &buf[i * page_size], page_size, pages[i]) == page_size;
+    }
+  }
+
+  // Patch each page, writing back the span between its first and last site
+  size_t next = 0;
+  for (size_t i = 0; i < pages.size(); i++) {
+    uint8_t *page_buf = &buf[i * page_size];
+    intptr_t low = page_size, high = -1;
+    std::vector<site*> patched;
+    for (; next < addrs.size() && (addrs[next] & ~(page_size - 1)) == pages[i]; next++) {
+      if (!read_ok[i]) {
+        continue;
+      }
+      site &s = sites[addrs[next]];
+      intptr_t off = addrs[next] - pages[i];
+      if (s.enabled) {
+        page_buf[off] = s.saved_data;
+      } else {
+        s.saved_data = page_buf[off];
+        page_buf[off] = INT3;
+      }
+      patched.push_back(&s);
+      low = std::min(low, off);
+      high = std::max(high, off);
+    }
+    if (patched.empty()) {
+      continue;
+    }
+
+    if (pwrite(mem_fd, page_buf + low, high - low + 1, pages[i] + low) == high - low + 1) {
+      for (auto s : patched) {
+        s->enabled = !s->enabled;
+        if (s->enabled) {
+          enabled_count++;
+        } else {
+          enabled_count--;
+        }
+      }
+    } else {
+      fprintf(stderr, "Failed to patch breakpoints at %lx\n", pages[i] + low);
+    }
+  }
+}
@@ -0,0 +1,118 @@
+/**
+* Breakpoint insertion based on code from:
+* https://blog.tartanllama.xyz/writing-a-linux-debugger-breakpoints/
+* https://blog.tartanllama.xyz/writing-a-linux-debugger-source-break/
+*/
+
+#ifndef _BREAKPOINT_MANAGER_HH_
+#define _BREAKPOINT_MANAGER_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Owns all the breakpoints of a traced process. Breakpoints are reference
+ *   counted, so that several users can share an address. Insertions and
+ *   removals are queued and applied together by flush(), which reads the
+ *   affected pages in a single process_vm_readv and writes each page back
+ *   through /proc/<pid>/mem. Memory is patched without going through a
+ *   stopped thread.
+ */
+class breakpoint_manager {
+public:
+
+  /**
+  * construct a new breakpoint manager
+  * @param pid the traced process
+  * @throws    std::runtime_error if the process' memory cannot be opened
+  */
+  breakpoint_manager(pid_t pid);
+
+  ~breakpoint_manager();
+
+  breakpoint_manager(const breakpoint_manager&) = delete;
+  breakpoint_manager& operator=(const breakpoint_manager&) = delete;
+
+  /**
+  * insert a breakpoint, or share an existing one. Takes effect at the next
+  *   flush().
+  * @param addr the breakpoint address
+  */
+  void insert(intptr_t addr);
+
+  /**
+  * release a breakpoint, removing it once it has no users. Takes effect at
+  *   the next flush().
+  * @param addr the breakpoint address
+  */
+  void remove(intptr_t addr);
+
+  /**
+  * apply the queued insertions and removals to the process' memory
+  */
+  void flush();
+
+  /**
+  * check whether a breakpoint instruction is in memory at an address
+  * @param  addr the address to check
+  * @return      true if a breakpoint is inserted at addr, false otherwise
+  */
+  bool contains(intptr_t addr) const;
+
+  /**
+  * check whether a SIGTRAP stop of a thread comes from a breakpoint
+  *   instruction at an address. Breakpoints removed since the thread
+  *   trapped still count, since another thread may have released them
+  *   while the stop was queued.
+  * @param  tid  the stopped thread
+  * @param  addr the address before the thread's instruction pointer
+  * @return      true if the thread executed a breakpoint at addr, false
+  *              otherwise
+  */
+  bool is_breakpoint_stop(pid_t tid, intptr_t addr) const;
+
+  /**
+  * execute the original instruction under a breakpoint, leaving the
+  *   breakpoint in place. The thread is stopped again afterwards. Signals
+  *   that arrive during the step are sent to the thread again, to be
+  *   reported at its next stop, except for a fault of the instruction
+  *   itself, which is delivered in place.
+  * @param  tid  a thread stopped at the breakpoint address
+  * @param  addr the breakpoint address
+  * @return      true if the thread is still stopped, false if it exited
+  */
+  bool step_over(pid_t tid, intptr_t addr);
+
+  /**
+  * @return the number of breakpoints inserted in memory
+  */
+  auto size() const -> size_t { return enabled_count; }
+
+private:
+  // A breakpoint address
+  struct site {
+    unsigned uses;      // Number of users of the breakpoint
+    bool enabled;       // Whether the breakpoint instruction is in memory
+    uint8_t saved_data; // Data originally at the breakpoint address
+  };
+
+  /**
+  * write the breakpoint instruction, or the original data, at a set of sites
+  * @param addrs the addresses of the sites to patch, sorted
+  */
+  void patch(const std::vector<intptr_t> &addrs);
+
+  pid_t pid;                                  // The traced process
+  int mem_fd;                                 // /proc/<pid>/mem
+  size_t enabled_count;                       // Number of sites in memory
+  std::unordered_map<intptr_t, site> sites;   // Breakpoints by address
+  std::vector<intptr_t> pending;              // Sites changed since the last flush
+  std::unordered_set<intptr_t> removed;       // Addresses of the sites removed so far
+};
+
+#endif /* _BREAKPOINT_MANAGER_HH_ */
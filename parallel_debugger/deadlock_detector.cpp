@@ -0,0 +1,274 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "deadlock_detector.hh"
+
+/**
+* compute the time between two instants
+* @param  from the earlier instant
+* @param  to   the later instant
+* @return      the elapsed time, in milliseconds
+*/
+static unsigned long elapsed_ms(const struct timespec &from, const struct timespec &to) {
+  return (to.tv_sec - from.tv_sec) * 1000 + (to.tv_nsec - from.tv_nsec) / 1000000;
+}
+
+/**
+* construct a new deadlock detector
+* @param stall_ms how long a thread may wait for a lock or a thread before
+*                 it is reported as stalled
+*/
+deadlock_detector::deadlock_detector(unsigned long stall_ms)
+: stall_ms{stall_ms} {
+  clock_gettime(CLOCK_MONOTONIC, &last_check);
+}
+
+/**
+* record which thread a clone event created, to map its pthread_t once
+*   pthread_create returns
+* @param parent the thread that called pthread_create
+* @param child  the new thread
+*/
+void deadlock_detector::thread_created(pid_t parent, pid_t child) {
+  last_created[parent] = child;
+}
+
+/**
+* update the graph with a lock event
+* @param  event the event
+* @param  links set to the threads of the deadlock the event completes
+* @return       true if the event completes a deadlock, false otherwise
+*/
+bool deadlock_detector::handle_event(const lock_event &event, std::vector<deadlock_link> &links) {
+  links.clear();
+  switch (event.type) {
+    case lock_event::LOCK:
+    case lock_event::JOIN: {
+      wait_state wait {event.type, event.object, event.call_site, {0, 0}, false};
+      clock_gettime(CLOCK_MONOTONIC, &wait.since);
+      waits[event.tid] = wait;
+      break;
+    }
+    case lock_event::ACQUIRED: {
+      waits.erase(event.tid);
+      mutex_state &mutex = mutexes[event.object];
+      if (mutex.count > 0 && mutex.owner == event.tid) {
+        mutex.count++;
+      } else {
+        mutex = mutex_state{event.tid, event.call_site, 1, false, false};
+      }
+      return false;
+    }
+    case lock_event::UNLOCK: {
+      // Mutexes that were not acquired through pthread_mutex_lock, e.g. by
+      //   pthread_cond_wait, are not tracked
+      auto it = mutexes.find(event.object);
+      if (it != mutexes.end() && it->second.owner == event.tid && --it->second.count == 0) {
+        mutexes.erase(it);
+      }
+      return false;
+    }
+    case lock_event::CREATED: {
+      auto it = last_created.find(event.tid);
+      if (it != last_created.end()) {
+        handles[event.object] = it->second;
+        last_created.erase(it);
+      }
+      return false;
+    }
+    case lock_event::JOINED: {
+      waits.erase(event.tid);
+      auto it = handles.find(event.object);
+      if (it != handles.end()) {
+        exited_threads.erase(it->second);
+        handles.erase(it);
+      }
+      return false;
+    }
+    default:
+      return false;
+  }
+
+  // The new edge closes a deadlock if following the edges from the waiting
+  //   thread leads back to it, or to a mutex that is never released. Any
+  //   other cycle on the way was reported when it was closed.
+  std::vector<pid_t> chain;
+  pid_t current = event.tid;
+  bool exited = false;
+  while (chain.size() <= waits.size()) {
+    auto it = waits.find(current);
+    if (it == waits.end()) {
+      return false;
+    }
+    chain.push_back(current);
+    pid_t holder = get_holder(it->second, exited);
+    if (holder == 0) {
+      return false;
+    }
+    if (exited || holder == event.tid) {
+      break;
+    }
+    current = holder;
+  }
+  if (chain.size() > waits.size()) {
+    return false;
+  }
+
+  // A thread locking a mutex it holds is only blocked if the mutex is not
+  //   recursive, which cannot be told here: the stall time decides
+  if (!exited && chain.size() == 1) {
+    return false;
+  }
+  if (exited) {
+    mutex_state &mutex = mutexes[waits[chain.back()].object];
+    if (mutex.reported) {
+      return false;
+    }
+    mutex.reported = true;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  for (auto tid : chain) {
+    links.push_back(make_link(tid, waits[tid], now));
+  }
+  return true;
+}
+
+/**
+* update the graph when a thread exits
+* @param  tid   the exited thread
+* @param  links set to the threads waiting for a mutex the thread held
+* @return       true if the thread exited holding a mutex that other
+*               threads wait for, false otherwise
+*/
+bool deadlock_detector::thread_exited(pid_t tid, std::vector<deadlock_link> &links) {
+  links.clear();
+  waits.erase(tid);
+  last_created.erase(tid);
+  // Kept until the thread is joined, so that joining it does not block
+  exited_threads.insert(tid);
+
+  // Only held mutexes are in the map
+  bool held = false;
+  for (auto &mutex : mutexes) {
+    if (mutex.second.owner == tid) {
+      mutex.second.owner_exited = true;
+      held = true;
+    }
+  }
+  if (!held) {
+    return false;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  for (auto &wait : waits) {
+    bool exited;
+    if (get_holder(wait.second, exited) == tid) {
+      mutexes[wait.second.object].reported = true;
+      links.push_back(make_link(wait.first, wait.second, now));
+    }
+  }
+  return !links.empty();
+}
+
+/**
+* find the threads that have waited longer than the stall time and were not
+*   reported yet. The threads are checked at most twice per stall time.
+* @param  links set to the stalled threads
+* @return       true if a thread stalled, false otherwise
+*/
+bool deadlock_detector::find_stalled(std::vector<deadlock_link> &links) {
+  links.clear();
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (elapsed_ms(last_check, now) < stall_ms / 2) {
+    return false;
+  }
+  last_check = now;
+
+  for (auto &wait : waits) {
+    if (!wait.second.reported && elapsed_ms(wait.second.since, now) >= stall_ms) {
+      links.push_back(make_link(wait.first, wait.second, now));
+    }
+  }
+  return !links.empty();
+}
+
+/**
+* check whether every live thread waits for a mutex held by another
+*   thread, or for another thread
+* @param  live  the number of live threads
+* @param  links set to every blocked thread
+* @return       true if every thread is blocked, false otherwise
+*/
+bool deadlock_detector::all_blocked(size_t live, std::vector<deadlock_link> &links) {
+  links.clear();
+  if (live == 0 || waits.size() < live) {
+    return false;
+  }
+  for (auto &wait : waits) {
+    bool exited;
+    if (get_holder(wait.second, exited) == 0) {
+      return false;
+    }
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  for (auto &wait : waits) {
+    links.push_back(make_link(wait.first, wait.second, now));
+  }
+  return true;
+}
+
+/**
+* find the thread a waiting thread waits for
+* @param  wait   what the thread waits for
+* @param  exited set to true if it waits for a mutex whose owner exited
+* @return        the thread, or 0 if it is not known or not blocking
+*/
+pid_t deadlock_detector::get_holder(const wait_state &wait, bool &exited) {
+  exited = false;
+  if (wait.type == lock_event::LOCK) {
+    auto it = mutexes.find(wait.object);
+    if (it == mutexes.end()) {
+      return 0;
+    }
+    exited = it->second.owner_exited;
+    return it->second.owner;
+  }
+
+  // Joining a thread that already exited does not block
+  auto it = handles.find(wait.object);
+  if (it == handles.end() || exited_threads.count(it->second) != 0) {
+    return 0;
+  }
+  return it->second;
+}
+
+/**
+* describe the wait of a thread
+* @param  tid  the waiting thread
+* @param  wait what the thread waits for
+* @param  now  the current time
+* @return      the thread's link in the wait-for graph. The wait is marked
+*              as reported.
+*/
+deadlock_link deadlock_detector::make_link(pid_t tid, wait_state &wait, const struct timespec &now) {
+  deadlock_link link {};
+  link.tid = tid;
+  link.type = wait.type;
+  link.object = wait.object;
+  link.blocked_at = wait.blocked_at;
+  link.holder = get_holder(wait, link.holder_exited);
+  if (wait.type == lock_event::LOCK && link.holder != 0) {
+    link.acquired_at = mutexes[wait.object].acquired_at;
+  }
+  link.waited_ms = elapsed_ms(wait.since, now);
+  wait.reported = true;
+  return link;
+}
@@ -0,0 +1,139 @@
+#ifndef _DEADLOCK_DETECTOR_HH_
+#define _DEADLOCK_DETECTOR_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "lock_tracer.hh"
+
+// A blocked thread, and the thread it waits for
+struct deadlock_link {
+  pid_t tid;            // Blocked thread
+  lock_event::kind type; // LOCK or JOIN
+  uintptr_t object;     // Mutex, or pthread_t of the joined thread
+  intptr_t blocked_at;  // Return address of the blocking call
+  pid_t holder;         // Thread holding the mutex or being joined, 0 if unknown
+  intptr_t acquired_at; // Return address of the holder's pthread_mutex_lock,
+                        //   0 for joins
+  bool holder_exited;   // Whether the holder exited without unlocking the mutex
+  unsigned long waited_ms; // How long the thread has been waiting
+};
+
+/**
+ * Detects deadlocks from the events of a lock_tracer, with a wait-for graph.
+ *   Each thread waits for at most one mutex or thread at a time, so the
+ *   graph has at most one edge out of each thread. A cycle can only be
+ *   closed by a new edge, so each wait is checked by following the edges
+ *   from the waiting thread only, which costs the length of that chain no
+ *   matter how many threads and locks there are.
+ */
+class deadlock_detector {
+public:
+
+  /**
+  * construct a new deadlock detector
+  * @param stall_ms how long a thread may wait for a lock or a thread before
+  *                 it is reported as stalled
+  */
+  deadlock_detector(unsigned long stall_ms);
+
+  /**
+  * record which thread a clone event created, to map its pthread_t once
+  *   pthread_create returns
+  * @param parent the thread that called pthread_create
+  * @param child  the new thread
+  */
+  void thread_created(pid_t parent, pid_t child);
+
+  /**
+  * update the graph with a lock event
+  * @param  event the event
+  * @param  links set to the threads of the deadlock the event completes
+  * @return       true if the event completes a deadlock, false otherwise
+  */
+  bool handle_event(const lock_event &event, std::vector<deadlock_link> &links);
+
+  /**
+  * update the graph when a thread exits
+  * @param  tid   the exited thread
+  * @param  links set to the threads waiting for a mutex the thread held
+  * @return       true if the thread exited holding a mutex that other
+  *               threads wait for, false otherwise
+  */
+  bool thread_exited(pid_t tid, std::vector<deadlock_link> &links);
+
+  /**
+  * find the threads that have waited longer than the stall time and were not
+  *   reported yet. The threads are checked at most twice per stall time.
+  * @param  links set to the stalled threads
+  * @return       true if a thread stalled, false otherwise
+  */
+  bool find_stalled(std::vector<deadlock_link> &links);
+
+  /**
+  * check whether every live thread waits for a mutex held by another
+  *   thread, or for another thread
+  * @param  live  the number of live threads
+  * @param  links set to every blocked thread
+  * @return       true if every thread is blocked, false otherwise
+  */
+  bool all_blocked(size_t live, std::vector<deadlock_link> &links);
+
+  /**
+  * @return the stall time, in milliseconds
+  */
+  auto get_stall_ms() const -> unsigned long { return stall_ms; }
+
+private:
+  // A mutex acquired through pthread_mutex_lock
+  struct mutex_state {
+    pid_t owner;          // Thread holding the mutex
+    intptr_t acquired_at; // Return address of the owner's pthread_mutex_lock
+    unsigned count;       // Times the owner acquired it, for recursive mutexes
+    bool owner_exited;    // Whether the owner exited without unlocking it
+    bool reported;        // Whether its waiters were reported as deadlocked
+  };
+
+  // A thread inside pthread_mutex_lock or pthread_join
+  struct wait_state {
+    lock_event::kind type;   // LOCK or JOIN
+    uintptr_t object;        // Mutex, or pthread_t of the joined thread
+    intptr_t blocked_at;     // Return address of the call
+    struct timespec since;   // When the call was made
+    bool reported;           // Whether the wait was reported already
+  };
+
+  /**
+  * find the thread a waiting thread waits for
+  * @param  wait   what the thread waits for
+  * @param  exited set to true if it waits for a mutex whose owner exited
+  * @return        the thread, or 0 if it is not known or not blocking
+  */
+  pid_t get_holder(const wait_state &wait, bool &exited);
+
+  /**
+  * describe the wait of a thread
+  * @param  tid  the waiting thread
+  * @param  wait what the thread waits for
+  * @param  now  the current time
+  * @return      the thread's link in the wait-for graph. The wait is marked
+  *              as reported.
+  */
+  deadlock_link make_link(pid_t tid, wait_state &wait, const struct timespec &now);
+
+  unsigned long stall_ms;                               // Time before a wait is reported
+  struct timespec last_check;                           // Last search for stalled threads
+  std::unordered_map<uintptr_t, mutex_state> mutexes;   // Held mutexes
+  std::unordered_map<pid_t, wait_state> waits;          // Waiting threads
+  std::unordered_map<uintptr_t, pid_t> handles;         // Thread of each pthread_t
+  std::unordered_map<pid_t, pid_t> last_created;        // Last thread created by each thread
+  std::unordered_set<pid_t> exited_threads;             // Exited threads, until joined
+};
+
+#endif /* _DEADLOCK_DETECTOR_HH_ */
@@ -0,0 +1,843 @@
+#include <inttypes.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <system_error>
+
+#include "debug_info.hh"
+#include "index_cache.hh"
+
+// DWARF expression operations of frame bases and local variables
+#define DW_OP_REG6           0x56
+#define DW_OP_BREG6          0x76
+#define DW_OP_FBREG          0x91
+#define DW_OP_CALL_FRAME_CFA 0x9c
+
+/**
+* open an ELF file and parse its headers
+* @param file_path the absolute path of the file
+* @throws          std::invalid_argument if the file cannot be opened or is
+*                  not an ELF file
+*/
+debug_info::debug_info(std::string file_path)
+: path{file_path}, lines_loaded{false}, dwarf_loaded{false}, functions_loaded{false},
+  frames_loaded{false}, names_loaded{false}, has_compilation_units{false} {
+
+  int fd = open(file_path.c_str(), O_RDONLY);
+
+  // Check if this is a readable file
+  if( fd == -1 ) {
+    throw std::invalid_argument{"Cannot open file '" + file_path + "'"};
+  }
+
+  // Parse the ELF headers. The mmap loader takes ownership of fd.
+  try {
+    elf_file = elf::elf(elf::create_mmap_loader(fd));
+  } catch(std::system_error &e) {
+    close(fd);
+    throw std::invalid_argument{"Cannot load file '" + file_path + "'"};
+  } catch(elf::format_error &e) {
+    throw std::invalid_argument{"Not an ELF file '" + file_path + "'"};
+  }
+
+  // ELF type (exec or dynamic)
+  this->type = elf_file.get_hdr().type;
+}
+
+/**
+* load the file's line index from the index cache, or build it from the
+*   DWARF information and store it in the cache, unless this was already done
+*/
+void debug_info::load_lines() {
+  // Symbolizing threads may get here at the same time. Once loaded, the
+  //   index is only read, without the lock.
+  if (lines_loaded) {
+    return;
+  }
+  std::lock_guard<std::recursive_mutex> guard{elfin_lock};
+  if (lines_loaded) {
+    return;
+  }
+
+  // Use the index written by an earlier session, if any
+  std::string cache_path = index_cache_path(elf_file, path);
+  if (cache_path.empty() || !lines.load(cache_path, has_compilation_units)) {
+    load_dwarf();
+    if (has_compilation_units) {
+      // Flatten every line table and function range into one sorted index
+      for (auto &cu : compilation_units) {
+        auto &lt = cu.get_line_table();
+        if (lt.valid()) {
+          lines.add_line_table(lt);
+        }
+        lines.add_functions(cu);
+      }
+    }
+    lines.finish();
+
+    if (!cache_path.empty()) {
+      lines.save(cache_path, has_compilation_units);
+    }
+  }
+  lines_loaded = true;
+}
+
+/**
+* parse the file's DWARF information, unless this was already done
+*/
+void debug_info::load_dwarf() {
+  std::lock_guard<std::recursive_mutex> guard{elfin_lock};
+  if (dwarf_loaded) {
+    return;
+  }
+  // Initialize this file's debugging information
+  try {
+    dwarf::dwarf dwarf(dwarf::elf::create_loader(elf_file));
+    this->compilation_units = dwarf.compilation_units();
+    this->has_compilation_units = true;
+  } catch(dwarf::format_error& e) {
+    // If file is not a valid dwarf file
+    this->has_compilation_units = false;
+  }
+  dwarf_loaded = true;
+}
+
+/**
+* sort the defined functions of the file's symbol tables by address, unless
+*   this was already done
+*/
+void debug_info::load_functions() {
+  if (functions_loaded) {
+    return;
+  }
+  std::lock_guard<std::recursive_mutex> guard{elfin_lock};
+  if (functions_loaded) {
+    return;
+  }
+  // Stripped libraries only keep the dynamic symbol table, and other files
+  //   usually list their exported functions in both
+  for (const auto &sec : elf_file.sections()) {
+    auto table = sec.get_hdr().type;
+    if (table != elf::sht::dynsym && table != elf::sht::symtab) {
+      continue;
+    }
+    for (auto sym : sec.as_symtab()) {
+      auto &data = sym.get_data();
+      if (data.type() == elf::stt::func && data.shnxd != 0 && data.value != 0 && data.size > 0) {
+        functions.push_back(function_symbol{data.value, data.value + data.size, sym.get_name()});
+      }
+    }
+  }
+  std::sort(functions.begin(), functions.end(),
+            [](const function_symbol &a, const function_symbol &b) { return a.start < b.start; });
+  functions_loaded = true;
+}
+
+/**
+* index the defined functions of the file's symbol tables and DWARF
+*   information by name, unless this was already done
+*/
+void debug_info::load_function_names() {
+  std::lock_guard<std::recursive_mutex> guard{elfin_lock};
+  if (names_loaded) {
+    return;
+  }
+  // The dynamic symbol table first: a local function of .symtab may have
+  //   the name of an exported one
+  for (auto table : {elf::sht::dynsym, elf::sht::symtab}) {
+    for (const auto &sec : elf_file.sections()) {
+      if (sec.get_hdr().type != table) {
+        continue;
+      }
+      for (auto sym : sec.as_symtab()) {
+        auto &data = sym.get_data();
+        if (data.type() == elf::stt::func && data.shnxd != 0 && data.value != 0) {
+          function_names.emplace(sym.get_name(),
+                                 function_entry{data.value, data.value + data.size, -1});
+        }
+      }
+    }
+  }
+
+  // Then the subprograms of each unit, which give the function's unit.
+  //   Declarations have no address.
+  load_dwarf();
+  for (size_t i = 0; i < compilation_units.size(); i++) {
+    try {
+      for (const auto& die : compilation_units[i].root()) {
+        if (die.tag != dwarf::DW_TAG::subprogram || !die.has(dwarf::DW_AT::name)
+            || !die.has(dwarf::DW_AT::low_pc)) {
+          continue;
+        }
+        function_entry entry {at_low_pc(die), at_low_pc(die), (int32_t)i};
+        if (die.has(dwarf::DW_AT::high_pc)) {
+          entry.high = at_high_pc(die);
+        }
+        // Keep the symbol table's function if it is another one, e.g. a
+        //   static function named like an exported one
+        auto it = function_names.emplace(at_name(die), entry).first;
+        if (it->second.cu < 0 && it->second.low == entry.low) {
+          it->second = entry;
+        }
+      }
+    } catch(std::exception &e) {
+      // Malformed unit: keep the functions found so far
+    }
+  }
+  names_loaded = true;
+}
+
+/**
+* decode the file's call frame information, unless this was already done
+*/
+void debug_info::load_frames() {
+  if (frames_loaded) {
+    return;
+  }
+  std::lock_guard<std::recursive_mutex> guard{elfin_lock};
+  if (frames_loaded) {
+    return;
+  }
+  // Most files only have .eh_frame. .debug_frame may describe functions
+  //   that .eh_frame leaves out.
+  for (auto name : {".eh_frame", ".debug_frame"}) {
+    const auto &sec = elf_file.get_section(name);
+    if (sec.valid() && sec.get_hdr().type != elf::sht::nobits) {
+      frames.add_section(static_cast<const char*>(sec.data()), sec.size(), sec.get_hdr().addr,
+                         strcmp(name, ".eh_frame") == 0);
+    }
+  }
+  frames.finish();
+  frames_loaded = true;
+}
+
+/**
+* build the file's line index, address-sorted function symbols and call
+*   frame information, unless this was already done, so that later
+*   lookups do not have to
+*/
+void debug_info::preload() {
+  load_lines();
+  load_functions();
+  load_frames();
+}
+
+/**
+* find the load bias of a mapping of this file, i.e. the difference between
+*   the system memory addresses of the mapping and the addresses used in
+*   the file's symbol and line tables
+* @param  addr_start the starting address of the mapping in system memory
+* @param  offset     the file offset mapped at addr_start
+* @return            the load bias of the mapping
+*/
+intptr_t debug_info::load_bias(intptr_t addr_start, uint64_t offset) const {
+  long page_size = sysconf(_SC_PAGESIZE);
+
+  // Find the loadable segment this mapping was created from
+  for (auto &seg : elf_file.segments()) {
+    auto &hdr = seg.get_hdr();
+    if (hdr.type != elf::pt::load) {
+      continue;
+    }
+    uint64_t seg_start = hdr.offset & ~(page_size - 1);
+    if (seg_start <= offset && offset < hdr.offset + hdr.filesz) {
+      // addr_start holds the file offset 'offset', which the segment places
+      //   at vaddr + (offset - segment offset)
+      return addr_start - (intptr_t)(hdr.vaddr + offset - hdr.offset);
+    }
+  }
+
+  // No matching segment: assume file offsets and addresses coincide
+  return addr_start - offset;
+}
+
+/**
+* get the loadable segments of this file, as the dynamic linker maps them
+* @param segments a vector to append the segments to
+*/
+void debug_info::get_load_segments(std::vector<load_segment> &segments) const {
+  uint64_t page_size = sysconf(_SC_PAGESIZE);
+  size_t first = segments.size();
+  for (auto &seg : elf_file.segments()) {
+    auto &hdr = seg.get_hdr();
+    if (hdr.type != elf::pt::load || hdr.memsz == 0) {
+      continue;
+    }
+    // Addresses and offsets are congruent modulo the page size
+    load_segment load {hdr.vaddr & ~(page_size - 1),
+                       (hdr.vaddr + hdr.memsz + page_size - 1) & ~(page_size - 1),
+                       hdr.offset & ~(page_size - 1)};
+    // Segments may share a page, which is mapped once
+    if (segments.size() > first && load.start < segments.back().end) {
+      load.offset += segments.back().end - load.start;
+      load.start = segments.back().end;
+    }
+    if (load.start < load.end) {
+      segments.push_back(load);
+    }
+  }
+}
+
+/**
+* get the address ranges of the function containing an address
+* @param  addr   a file-relative address
+* @param  ranges a vector to append the function's [low, high) ranges to
+* @return        true if a function was found, false otherwise
+*/
+bool debug_info::get_function_ranges(uint64_t addr,
+                                     std::vector<std::pair<uint64_t, uint64_t>> &ranges) {
+  std::lock_guard<std::recursive_mutex> guard{elfin_lock};
+  load_dwarf();
+
+  try {
+    for (const auto& cu : compilation_units) {
+      if (!die_pc_range(cu.root()).contains(addr)) {
+        continue;
+      }
+      // Look for the subprogram among the unit's top-level entries
+      for (const auto& die : cu.root()) {
+        if (die.tag != dwarf::DW_TAG::subprogram) {
+          continue;
+        }
+        auto pc_range = die_pc_range(die);
+        if (pc_range.contains(addr)) {
+          for (auto &range : pc_range) {
+            ranges.push_back(std::make_pair(range.low, range.high));
+          }
+          return true;
+        }
+      }
+    }
+  } catch(std::exception &e) {
+    // Malformed or missing range attributes
+  }
+  return false;
+}
+
+/**
+* decode a LEB128 number of a DWARF expression
+* @param  p         the first byte of the number, moved past it
+* @param  end       the end of the expression
+* @param  is_signed whether the number is a signed LEB128
+* @param  value     set to the number
+* @return           true if the number was decoded, false if it is truncated
+*/
+static bool read_leb128(const uint8_t* &p, const uint8_t* end, bool is_signed, int64_t &value) {
+  uint64_t result = 0;
+  unsigned shift = 0;
+  uint8_t byte;
+  do {
+    if (p == end || shift > 63) {
+      return false;
+    }
+    byte = *p++;
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  if (is_signed && shift < 64 && (byte & 0x40)) {
+    result |= ~(uint64_t)0 << shift;
+  }
+  value = result;
+  return true;
+}
+
+/**
+* get the size of a type, looking through typedefs and qualifiers
+* @param  type a type DIE
+* @return      the size of the type in bytes, or 0 if unknown
+*/
+static uint64_t type_size(dwarf::die type) {
+  while (type.valid()) {
+    if (type.has(dwarf::DW_AT::byte_size)) {
+      return type[dwarf::DW_AT::byte_size].as_uconstant();
+    }
+    if ((type.tag != dwarf::DW_TAG::typedef_ && type.tag != dwarf::DW_TAG::const_type
+         && type.tag != dwarf::DW_TAG::volatile_type) || !type.has(dwarf::DW_AT::type)) {
+      break;
+    }
+    type = type[dwarf::DW_AT::type].as_reference();
+  }
+  return 0;
+}
+
+/**
+* find a member of a structure, looking through typedefs and qualifiers
+* @param  type   the structure's type DIE, set to the member's type
+* @param  member the name of the member
+* @param  offset set to the offset of the member in the structure
+* @return        true if the member was found, false otherwise
+*/
+static bool find_member(dwarf::die &type, const std::string &member, uint64_t &offset) {
+  while (type.valid() && (type.tag == dwarf::DW_TAG::typedef_ || type.tag == dwarf::DW_TAG::const_type
+                          || type.tag == dwarf::DW_TAG::volatile_type)) {
+    if (!type.has(dwarf::DW_AT::type)) {
+      return false;
+    }
+    type = type[dwarf::DW_AT::type].as_reference();
+  }
+  if (!type.valid() || type.tag != dwarf::DW_TAG::structure_type) {
+    return false;
+  }
+  for (const auto& child : type) {
+    // Members located by an expression, as in DWARF 2, are not supported
+    if (child.tag == dwarf::DW_TAG::member && child.has(dwarf::DW_AT::name)
+        && at_name(child) == member && child.has(dwarf::DW_AT::data_member_location)
+        && child.has(dwarf::DW_AT::type)
+        && child[dwarf::DW_AT::data_member_location].get_type() != dwarf::value::type::exprloc
+        && child[dwarf::DW_AT::data_member_location].get_type() != dwarf::value::type::block) {
+      offset = child[dwarf::DW_AT::data_member_location].as_uconstant();
+      type = child[dwarf::DW_AT::type].as_reference();
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+* find a global variable by name
+* @param  name the name of the variable
+* @param  addr set to the file-relative address of the variable
+* @param  size set to the size of the variable in bytes, or 0 if unknown
+* @return      true if the variable was found, false otherwise
+*/
+bool debug_info::find_variable(const std::string &name, uint64_t &addr, uint64_t &size) {
+  std::lock_guard<std::recursive_mutex> guard{elfin_lock};
+  load_dwarf();
+
+  for (const auto& cu : compilation_units) {
+    // Globals are top-level entries. Declarations have no location.
+    for (const auto& die : cu.root()) {
+      if (die.tag != dwarf::DW_TAG::variable || !die.has(dwarf::DW_AT::name)
+          || !die.has(dwarf::DW_AT::location) || at_name(die) != name) {
+        continue;
+      }
+      try {
+        auto location = die[dwarf::DW_AT::location];
+        if (location.get_type() != dwarf::value::type::exprloc) {
+          continue;
+        }
+        // A static location is a single DW_OP_addr, which needs no context
+        auto result = location.as_exprloc().evaluate(&dwarf::no_expr_context);
+        if (result.location_type != dwarf::expr_result::type::address) {
+          continue;
+        }
+        addr = result.value;
+        size = die.has(dwarf::DW_AT::type) ? type_size(die[dwarf::DW_AT::type].as_reference()) : 0;
+        return true;
+      } catch(std::exception &e) {
+        // Locations that depend on registers or thread-local storage
+      }
+    }
+  }
+  return false;
+}
+
+/**
+* find a local variable of a function by name. Only variables whose
+*   location is a single DW_OP_fbreg, as compilers emit without
+*   optimization, are found.
+* @param  function the name of the function
+* @param  name     the name of the variable, or of a member of a structure
+*                  variable, as in args.count
+* @param  offset   set to the offset of the variable from the function's
+*                  canonical frame address (CFA)
+* @param  size     set to the size of the variable in bytes, or 0 if unknown
+* @return          true if the variable was found, false otherwise
+*/
+bool debug_info::find_local_variable(const std::string &function, const std::string &name,
+                                     int64_t &offset, uint64_t &size) {
+  std::lock_guard<std::recursive_mutex> guard{elfin_lock};
+  function_entry entry;
+  if (!find_function(function, entry) || entry.cu < 0) {
+    return false;
+  }
+
+  try {
+    for (const auto& die : compilation_units[entry.cu].root()) {
+      if (die.tag != dwarf::DW_TAG::subprogram || !die.has(dwarf::DW_AT::low_pc)
+          || at_low_pc(die) != entry.low || !die.has(dwarf::DW_AT::frame_base)) {
+        continue;
+      }
+
+      // The frame base, relative to the CFA. With a frame pointer, the
+      //   prologue saves the caller's right below the return address, so
+      //   rbp is CFA - 16 once the prologue ran.
+      const uint8_t* data;
+      size_t len;
+      int64_t base;
+      if (!get_expr_bytes(die[dwarf::DW_AT::frame_base], data, len) || len == 0) {
+        return false;
+      }
+      const uint8_t* p = data + 1;
+      if (data[0] == DW_OP_CALL_FRAME_CFA && len == 1) {
+        base = 0;
+      } else if (data[0] == DW_OP_REG6 && len == 1) {
+        base = -16;
+      } else if (data[0] == DW_OP_BREG6 && read_leb128(p, data + len, true, base)
+                 && p == data + len) {
+        base -= 16;
+      } else {
+        return false;
+      }
+
+      // Variables may be in nested lexical blocks
+      std::vector<dwarf::die> todo {die};
+      while (!todo.empty()) {
+        dwarf::die parent = todo.back();
+        todo.pop_back();
+        for (const auto& child : parent) {
+          if (child.tag == dwarf::DW_TAG::lexical_block) {
+            todo.push_back(child);
+            continue;
+          }
+          if ((child.tag != dwarf::DW_TAG::variable && child.tag != dwarf::DW_TAG::formal_parameter)
+              || !child.has(dwarf::DW_AT::name) || !child.has(dwarf::DW_AT::location)
+              || at_name(child) != name.substr(0, name.find('.'))) {
+            continue;
+          }
+          int64_t var_offset;
+          if (!get_expr_bytes(child[dwarf::DW_AT::location], data, len) || len == 0
+              || data[0] != DW_OP_FBREG) {
+            continue;
+          }
+          p = data + 1;
+          if (!read_leb128(p, data + len, true, var_offset) || p != data + len) {
+            continue;
+          }
+          if (!child.has(dwarf::DW_AT::type)) {
+            offset = base + var_offset;
+            size = 0;
+            return name.find('.') == std::string::npos;
+          }
+
+          // Follow the members named after the variable
+          dwarf::die type = child[dwarf::DW_AT::type].as_reference();
+          for (size_t dot = name.find('.'); dot != std::string::npos; ) {
+            size_t next = name.find('.', dot + 1);
+            uint64_t member_offset;
+            if (!find_member(type, name.substr(dot + 1, next - dot - 1), member_offset)) {
+              return false;
+            }
+            var_offset += member_offset;
+            dot = next;
+          }
+          offset = base + var_offset;
+          size = type_size(type);
+          return true;
+        }
+      }
+      return false;
+    }
+  } catch(std::exception &e) {
+    // Malformed DWARF
+  }
+  return false;
+}
+
+/**
+* find a function by name, among the subprograms of the file's DWARF
+*   information and the functions of its ELF symbol tables
+* @param  name  the name of the function
+* @param  entry set to the function's address range and compilation unit
+* @return       true if a defined function was found, false otherwise
+*/
+bool debug_info::find_function(const std::string &name, function_entry &entry) {
+  load_function_names();
+  auto it = function_names.find(name);
+  if (it == function_names.end()) {
+    return false;
+  }
+  entry = it->second;
+  return true;
+}
+
+/**
+* find a function in the file's ELF symbol tables, or in its DWARF
+*   information
+* @param  name the name of the function
+* @param  addr set to the file-relative address of the function
+* @return      true if a defined function was found, false otherwise
+*/
+bool debug_info::find_function_symbol(const std::string &name, uint64_t &addr) {
+  function_entry entry;
+  if (!find_function(name, entry)) {
+    return false;
+  }
+  addr = entry.low;
+  return true;
+}
+
+/**
+* find a variable in the file's ELF symbol tables, such as a library's
+*   exported data
+* @param  name the name of the variable
+* @param  addr set to the file-relative address of the variable
+* @return      true if a defined variable was found, false otherwise
+*/
+bool debug_info::find_object_symbol(const std::string &name, uint64_t &addr) {
+  return find_symbol(name, elf::stt::object, addr);
+}
+
+/**
+* find a defined symbol of a given type in the file's ELF symbol tables,
+*   searching the dynamic symbol table first
+* @param  name the name of the symbol
+* @param  type the type of the symbol
+* @param  addr set to the file-relative address of the symbol
+* @return      true if the symbol was found, false otherwise
+*/
+bool debug_info::find_symbol(const std::string &name, elf::stt type, uint64_t &addr) {
+  std::lock_guard<std::recursive_mutex> guard{elfin_lock};
+  for (auto table : {elf::sht::dynsym, elf::sht::symtab}) {
+    for (const auto &sec : elf_file.sections()) {
+      if (sec.get_hdr().type != table) {
+        continue;
+      }
+      for (auto sym : sec.as_symtab()) {
+        // Imports are undefined (SHN_UNDEF), although an executable may give
+        //   them the address of their PLT entry
+        auto &data = sym.get_data();
+        if (data.type() == type && data.shnxd != 0 && data.value != 0
+            && sym.get_name() == name) {
+          addr = data.value;
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+/**
+* get the bytes of a DWARF expression attribute. libelfin can evaluate
+*   expressions, but not DW_OP_fbreg or DW_OP_call_frame_cfa.
+* @param  value the attribute
+* @param  data  set to the first byte of the expression
+* @param  len   set to the length of the expression
+* @return       true if the attribute is an expression, false otherwise
+*/
+bool debug_info::get_expr_bytes(const dwarf::value &value, const uint8_t* &data, size_t &len) {
+  if (value.get_type() != dwarf::value::type::exprloc) {
+    return false;
+  }
+  // An exprloc is the expression's ULEB128 length, followed by the
+  //   expression, at the attribute's offset in .debug_info
+  const auto &sec = elf_file.get_section(".debug_info");
+  if (!sec.valid() || value.get_section_offset() >= sec.size()) {
+    return false;
+  }
+  const uint8_t* start = static_cast<const uint8_t*>(sec.data());
+  const uint8_t* end = start + sec.size();
+  const uint8_t* p = start + value.get_section_offset();
+  int64_t expr_len;
+  if (!read_leb128(p, end, false, expr_len) || (uint64_t)expr_len > (uint64_t)(end - p)) {
+    return false;
+  }
+  data = p;
+  len = expr_len;
+  return true;
+}
+
+/**
+* find the innermost function containing an address, among the functions
+*   and inlined calls of the file's DWARF information, or else in its ELF
+*   symbol tables
+* @param  addr a file-relative address
+* @param  info set to the function's name, and the range of addresses it
+*              is the innermost function of
+* @return      true if a function was found, false otherwise
+*/
+bool debug_info::find_function_at(uint64_t addr, function_info &info) {
+  load_lines();
+  if (lines.find_function(addr, info)) {
+    return true;
+  }
+
+  // Code without debugging information, such as the C runtime's
+  load_functions();
+  // The last function starting at or before the address
+  auto it = std::upper_bound(functions.begin(), functions.end(), addr,
+                             [](uint64_t a, const function_symbol &f) { return a < f.start; });
+  if (it == functions.begin() || addr >= (it - 1)->end) {
+    return false;
+  }
+  --it;
+  info.name = it->name.c_str();
+  info.outer = nullptr;
+  info.address = it->start;
+  info.end = it->end;
+  return true;
+}
+
+/**
+* find the name of the function containing an address, naming the function
+*   an inlined call is in as well
+* @param  addr a file-relative address
+* @param  name set to the name of the function
+* @return      true if a function was found, false otherwise
+*/
+bool debug_info::find_function_name(uint64_t addr, std::string &name) {
+  function_info info;
+  if (!find_function_at(addr, info)) {
+    return false;
+  }
+  name = info.name;
+  if (info.outer != nullptr) {
+    name = name + " [inlined into " + info.outer + "]";
+  }
+  return true;
+}
+
+/**
+* get the line table entry corresponding to the first instruction of the
+*   given function
+* @param  name the name of the function to be looked up
+* @return      the corresponding dwarf line table entry
+* @throws      std::out_of_range if no line entry is found
+* Source:
+* https://blog.tartanllama.xyz/writing-a-linux-debugger-source-signal/
+*/
+dwarf::line_table::iterator debug_info::get_line_entry_from_function(const std::string& name) {
+  std::lock_guard<std::recursive_mutex> guard{elfin_lock};
+  function_entry function;
+  if (!find_function(name, function) || function.cu < 0) {
+    throw std::out_of_range{"Cannot find line entry"};
+  }
+
+  // Find lowest address for this function in its unit's line table
+  auto &lt = compilation_units[function.cu].get_line_table();
+  auto entry = lt.find_address(function.low);
+  if (entry == lt.end()) {
+    throw std::out_of_range{"Cannot find line entry"};
+  }
+  // skip function prologue to point to actual user code
+  return ++entry;
+}
+
+/********************
+* TESTING FUNCTIONS *
+*********************/
+/**
+ * Print to stdin each entry of the given line table, in the following format
+ *   <file path> <line number> <instruction address>
+ * @param lt a line table
+ */
+static void dump_line_table(const dwarf::line_table &lt)
+{
+  for (auto &line : lt) {
+    if (line.end_sequence)
+    printf("\n");
+    else
+    printf("%-40s%8d%#20" PRIx64 "\n", line.file->path.c_str(),
+    line.line, line.address);
+  }
+}
+
+/**
+ * Print to stdin the line table of each source file correspoding to this
+ *   file
+ */
+void debug_info::dump_all_line_tables() {
+  std::lock_guard<std::recursive_mutex> guard{elfin_lock};
+  load_dwarf();
+  for (auto &cu : compilation_units) {
+    printf("--- <%x>\n", (unsigned int)cu.get_section_offset());
+    dump_line_table(cu.get_line_table());
+    printf("\n");
+  }
+}
+
+/**
+* get the debugging information of a mapped file, opening it on first use
+* @param  file_path the absolute path of the file
+* @param  dev       the device number of the file, as found in the maps file
+* @param  inode     the inode number of the file
+* @return           the file's debugging information, or nullptr if the
+*                   file cannot be opened or is not an ELF file
+*/
+std::shared_ptr<debug_info> debug_info_cache::get(const std::string &file_path,
+                                                  unsigned long dev, unsigned long inode) {
+  key k {dev, inode, file_path};
+  auto it = files.find(k);
+  if (it != files.end()) {
+    return it->second;
+  }
+
+  // First mapping of this file: open it, remembering failures too so that
+  //   they are not retried for the file's other mappings
+  std::shared_ptr<debug_info> info;
+  try {
+    info = std::make_shared<debug_info>(file_path);
+    std::lock_guard<std::mutex> guard{queue_lock};
+    pending.push_back(info);
+    queue_ready.notify_one();
+  } catch(std::invalid_argument &e) {
+    info = nullptr;
+  }
+  files[k] = info;
+  return info;
+}
+
+/**
+* start building the tables of the files on worker threads, in the order
+*   the files are opened: first the files opened so far, then each file
+*   as get() opens it. Does nothing once the workers are started.
+* @param workers the number of worker threads, at most
+* @throws        std::system_error if no worker thread can be started
+*/
+void debug_info_cache::preload(unsigned workers) {
+  if (!loaders.empty()) {
+    return;
+  }
+  for (unsigned i = 0; i < workers; i++) {
+    try {
+      loaders.emplace_back([this]() {
+        // Each worker takes the next file not taken yet, and waits for more
+        //   files until preloading stops. A lookup needing a file being
+        //   loaded waits for the file's lock until it is done.
+        std::unique_lock<std::mutex> guard{queue_lock};
+        while (true) {
+          queue_ready.wait(guard, [this]() { return stopping || !pending.empty(); });
+          if (stopping) {
+            return;
+          }
+          std::shared_ptr<debug_info> next = pending.front();
+          pending.pop_front();
+          guard.unlock();
+          try {
+            next->preload();
+          } catch(std::exception &e) {
+            // Malformed DWARF: the lookup that needs it will fail the same way
+          }
+          guard.lock();
+        }
+      });
+    } catch(std::system_error &e) {
+      // Run with the workers started so far
+      if (loaders.empty()) {
+        throw;
+      }
+      break;
+    }
+  }
+}
+
+/**
+* stop preloading, waiting for the files being loaded
+*/
+debug_info_cache::~debug_info_cache() {
+  {
+    std::lock_guard<std::mutex> guard{queue_lock};
+    stopping = true;
+  }
+  queue_ready.notify_all();
+  for (auto &loader : loaders) {
+    loader.join();
+  }
+}
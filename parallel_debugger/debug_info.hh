@@ -0,0 +1,348 @@
+#ifndef _DEBUG_INFO_HH_
+#define _DEBUG_INFO_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "elf++.hh"
+#include "dwarf++.hh"
+#include "frame_table.hh"
+#include "line_index.hh"
+
+// A loadable segment of a file, rounded out to whole pages
+struct load_segment {
+  uint64_t start;  // File-relative address of the segment's first page
+  uint64_t end;    // File-relative end address (exclusive) of its last page
+  uint64_t offset; // File offset mapped at start
+};
+
+// A function found by name
+struct function_entry {
+  uint64_t low;  // File-relative address of the function's entry point
+  uint64_t high; // File-relative end address (exclusive), or low if unknown
+  int32_t cu;    // Compilation unit defining the function, or -1 if it is
+                 //   only in the ELF symbol tables
+};
+
+/**
+ * The ELF and DWARF information of a single file. Every mapping of the file
+ *   in the traced process shares one debug_info. Only the ELF headers are
+ *   read up front; the line index and the DWARF information are loaded the
+ *   first time they are needed, once even if several threads need them. The
+ *   line index is memory mapped from the on-disk index cache when possible.
+ *   libelfin loads sections and decodes entries lazily, without locking, so
+ *   every use of the ELF and DWARF objects holds the file's lock; the tables
+ *   built from them are only read once loaded.
+ */
+class debug_info {
+public:
+
+  /**
+  * open an ELF file and parse its headers
+  * @param file_path the absolute path of the file
+  * @throws          std::invalid_argument if the file cannot be opened or is
+  *                  not an ELF file
+  */
+  debug_info(std::string file_path);
+
+  /**
+  * checks whether debugging (line number) information could be obtained for
+  *   this file, loading it on first use
+  * @return true if this file has associated compilation_units;
+  *         false otherwise.
+  */
+  auto has_cus() -> bool { load_lines(); return has_compilation_units; }
+
+  /**
+  * @return absolute path of the file
+  */
+  auto get_path() const -> std::string { return path; }
+
+  /**
+  * @return the file's ELF type (executable or dynamic object)
+  */
+  auto get_type() const -> elf::et { return type; }
+
+  /**
+  * find the load bias of a mapping of this file, i.e. the difference between
+  *   the system memory addresses of the mapping and the addresses used in
+  *   the file's symbol and line tables
+  * @param  addr_start the starting address of the mapping in system memory
+  * @param  offset     the file offset mapped at addr_start
+  * @return            the load bias of the mapping
+  */
+  intptr_t load_bias(intptr_t addr_start, uint64_t offset) const;
+
+  /**
+  * get the loadable segments of this file, as the dynamic linker maps them
+  * @param segments a vector to append the segments to
+  */
+  void get_load_segments(std::vector<load_segment> &segments) const;
+
+  /**
+  * find the line table row covering a file-relative address
+  * @param  addr an address relative to the start of the file
+  * @param  info the row's file, line and address range
+  * @return      true if a row was found, false otherwise
+  */
+  bool find_line(uint64_t addr, line_info &info) { load_lines(); return lines.find(addr, info); }
+
+  /**
+  * get the rows of the line index starting within an address range
+  * @param low  the first file-relative address of the range
+  * @param high the end address (exclusive) of the range
+  * @param out  a vector to append the rows' file, line and address range to
+  */
+  void get_line_rows(uint64_t low, uint64_t high, std::vector<line_info> &out) {
+    load_lines();
+    lines.get_rows(low, high, out);
+  }
+
+  /**
+  * get the address ranges of the function containing an address
+  * @param  addr   a file-relative address
+  * @param  ranges a vector to append the function's [low, high) ranges to
+  * @return        true if a function was found, false otherwise
+  */
+  bool get_function_ranges(uint64_t addr, std::vector<std::pair<uint64_t, uint64_t>> &ranges);
+
+  /**
+  * find a global variable by name
+  * @param  name the name of the variable
+  * @param  addr set to the file-relative address of the variable
+  * @param  size set to the size of the variable in bytes, or 0 if unknown
+  * @return      true if the variable was found, false otherwise
+  */
+  bool find_variable(const std::string &name, uint64_t &addr, uint64_t &size);
+
+  /**
+  * find a local variable of a function by name. Only variables whose
+  *   location is a single DW_OP_fbreg, as compilers emit without
+  *   optimization, are found.
+  * @param  function the name of the function
+  * @param  name     the name of the variable, or of a member of a structure
+  *                  variable, as in args.count
+  * @param  offset   set to the offset of the variable from the function's
+  *                  canonical frame address (CFA)
+  * @param  size     set to the size of the variable in bytes, or 0 if unknown
+  * @return          true if the variable was found, false otherwise
+  */
+  bool find_local_variable(const std::string &function, const std::string &name,
+                           int64_t &offset, uint64_t &size);
+
+  /**
+  * find a function by name, among the subprograms of the file's DWARF
+  *   information and the functions of its ELF symbol tables
+  * @param  name  the name of the function
+  * @param  entry set to the function's address range and compilation unit
+  * @return       true if a defined function was found, false otherwise
+  */
+  bool find_function(const std::string &name, function_entry &entry);
+
+  /**
+  * find a function in the file's ELF symbol tables, or in its DWARF
+  *   information
+  * @param  name the name of the function
+  * @param  addr set to the file-relative address of the function
+  * @return      true if a defined function was found, false otherwise
+  */
+  bool find_function_symbol(const std::string &name, uint64_t &addr);
+
+  /**
+  * find a variable in the file's ELF symbol tables, such as a library's
+  *   exported data
+  * @param  name the name of the variable
+  * @param  addr set to the file-relative address of the variable
+  * @return      true if a defined variable was found, false otherwise
+  */
+  bool find_object_symbol(const std::string &name, uint64_t &addr);
+
+  /**
+  * find the innermost function containing an address, among the functions
+  *   and inlined calls of the file's DWARF information, or else in its ELF
+  *   symbol tables
+  * @param  addr a file-relative address
+  * @param  info set to the function's name, and the range of addresses it
+  *              is the innermost function of
+  * @return      true if a function was found, false otherwise
+  */
+  bool find_function_at(uint64_t addr, function_info &info);
+
+  /**
+  * find the name of the function containing an address, naming the function
+  *   an inlined call is in as well
+  * @param  addr a file-relative address
+  * @param  name set to the name of the function
+  * @return      true if a function was found, false otherwise
+  */
+  bool find_function_name(uint64_t addr, std::string &name);
+
+  /**
+  * get the file's call frame information, decoding it on first use
+  * @return the rows of the file's .eh_frame and .debug_frame sections
+  */
+  auto get_frames() -> const frame_table& { load_frames(); return frames; }
+
+  /**
+  * build the file's line index, address-sorted function symbols and call
+  *   frame information, unless this was already done, so that later
+  *   lookups do not have to
+  */
+  void preload();
+
+  /**
+  * get the line table entry corresponding to the first instruction of the
+  *   given function
+  * @param  name the name of the function to be looked up
+  * @return      the corresponding dwarf line table entry
+  * @throws      std::out_of_range if no line entry is found
+  * Source:
+  * https://blog.tartanllama.xyz/writing-a-linux-debugger-source-signal/
+  */
+  dwarf::line_table::iterator get_line_entry_from_function(const std::string& name);
+
+  /**
+   * Print to stdin the line table of each source file correspoding to this
+   *   file
+   */
+  void dump_all_line_tables();
+
+private:
+  /**
+  * load the file's line index from the index cache, or build it from the
+  *   DWARF information and store it in the cache, unless this was already done
+  */
+  void load_lines();
+
+  /**
+  * parse the file's DWARF information, unless this was already done
+  */
+  void load_dwarf();
+
+  /**
+  * sort the defined functions of the file's symbol tables by address, unless
+  *   this was already done
+  */
+  void load_functions();
+
+  /**
+  * decode the file's call frame information, unless this was already done
+  */
+  void load_frames();
+
+  /**
+  * index the defined functions of the file's symbol tables and DWARF
+  *   information by name, unless this was already done
+  */
+  void load_function_names();
+
+  /**
+  * find a defined symbol of a given type in the file's ELF symbol tables,
+  *   searching the dynamic symbol table first
+  * @param  name the name of the symbol
+  * @param  type the type of the symbol
+  * @param  addr set to the file-relative address of the symbol
+  * @return      true if the symbol was found, false otherwise
+  */
+  bool find_symbol(const std::string &name, elf::stt type, uint64_t &addr);
+
+  /**
+  * get the bytes of a DWARF expression attribute. libelfin can evaluate
+  *   expressions, but not DW_OP_fbreg or DW_OP_call_frame_cfa.
+  * @param  value the attribute
+  * @param  data  set to the first byte of the expression
+  * @param  len   set to the length of the expression
+  * @return       true if the attribute is an expression, false otherwise
+  */
+  bool get_expr_bytes(const dwarf::value &value, const uint8_t* &data, size_t &len);
+
+  // A defined function of the symbol tables
+  struct function_symbol {
+    uint64_t start;   // File-relative address of the function
+    uint64_t end;     // End address (exclusive) of the function
+    std::string name; // Name of the function
+  };
+
+  std::string path;           // Absolute path of the file
+  elf::elf elf_file;          // The parsed ELF file
+  elf::et type;               // File's ELF type (executable or dynamic object)
+  std::recursive_mutex elfin_lock; // Guards elf_file, compilation_units and the
+                              //   loading of the tables below
+  std::atomic<bool> lines_loaded; // Set once the line index is loaded
+  std::atomic<bool> dwarf_loaded; // Set once the DWARF information is loaded
+  std::atomic<bool> functions_loaded; // Set once the function symbols are sorted
+  std::atomic<bool> frames_loaded; // Set once the call frame information is decoded
+  std::atomic<bool> names_loaded; // Set once the functions are indexed by name
+  bool has_compilation_units; // Whether this file has associated compilation units
+  std::vector<dwarf::compilation_unit> compilation_units;
+  line_index lines;           // Flattened line tables of all compilation units
+  std::vector<function_symbol> functions; // Function symbols, sorted by address
+  frame_table frames;         // Call frame information
+  std::unordered_map<std::string, function_entry> function_names; // Defined functions by name
+};
+
+/**
+ * A cache of parsed files, so that each file is parsed only once no matter
+ *   how many times it is mapped. The tables of the files can be built ahead
+ *   of time on worker threads, which take the files from a queue as they
+ *   are opened, e.g. libraries mapped after the program started; a lookup
+ *   that needs a table still being built waits for it.
+ */
+class debug_info_cache {
+public:
+
+  debug_info_cache() : stopping{false} {}
+
+  /**
+  * stop preloading, waiting for the files being loaded
+  */
+  ~debug_info_cache();
+
+  debug_info_cache(const debug_info_cache&) = delete;
+  debug_info_cache& operator=(const debug_info_cache&) = delete;
+
+  /**
+  * get the debugging information of a mapped file, opening it on first use
+  * @param  file_path the absolute path of the file
+  * @param  dev       the device number of the file, as found in the maps file
+  * @param  inode     the inode number of the file
+  * @return           the file's debugging information, or nullptr if the
+  *                   file cannot be opened or is not an ELF file
+  */
+  std::shared_ptr<debug_info> get(const std::string &file_path, unsigned long dev,
+                                  unsigned long inode);
+
+  /**
+  * start building the tables of the files on worker threads, in the order
+  *   the files are opened: first the files opened so far, then each file
+  *   as get() opens it. Does nothing once the workers are started.
+  * @param workers the number of worker threads, at most
+  * @throws        std::system_error if no worker thread can be started
+  */
+  void preload(unsigned workers);
+
+private:
+  typedef std::tuple<unsigned long, unsigned long, std::string> key;
+  std::map<key, std::shared_ptr<debug_info>> files; // Parsed (or failed) files
+  std::deque<std::shared_ptr<debug_info>> pending;  // Valid files not preloaded yet,
+                                                    //   in opening order
+  std::mutex queue_lock;                            // Guards pending and stopping
+  std::condition_variable queue_ready;              // Signaled when pending grows or
+                                                    //   preloading stops
+  bool stopping;                                    // Whether preloading should stop
+  std::vector<std::thread> loaders;                 // Preloading threads
+};
+
+#endif /* _DEBUG_INFO_HH_ */
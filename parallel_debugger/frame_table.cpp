@@ -0,0 +1,538 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "frame_table.hh"
+
+// Pointer encodings of .eh_frame (DW_EH_PE_*)
+#define PE_OMIT    0xff
+#define PE_FORMAT  0x0f
+#define PE_ABSPTR  0x00
+#define PE_ULEB128 0x01
+#define PE_UDATA2  0x02
+#define PE_UDATA4  0x03
+#define PE_UDATA8  0x04
+#define PE_SLEB128 0x09
+#define PE_SDATA2  0x0a
+#define PE_SDATA4  0x0b
+#define PE_SDATA8  0x0c
+#define PE_APPLY   0x70
+#define PE_PCREL   0x10
+
+// Call frame instructions (DW_CFA_*). The first three keep an operand in
+//   their low 6 bits.
+#define CFA_ADVANCE_LOC        0x40
+#define CFA_OFFSET             0x80
+#define CFA_RESTORE            0xc0
+#define CFA_NOP                0x00
+#define CFA_SET_LOC            0x01
+#define CFA_ADVANCE_LOC1       0x02
+#define CFA_ADVANCE_LOC2       0x03
+#define CFA_ADVANCE_LOC4       0x04
+#define CFA_OFFSET_EXTENDED    0x05
+#define CFA_RESTORE_EXTENDED   0x06
+#define CFA_UNDEFINED          0x07
+#define CFA_SAME_VALUE         0x08
+#define CFA_REGISTER           0x09
+#define CFA_REMEMBER_STATE     0x0a
+#define CFA_RESTORE_STATE      0x0b
+#define CFA_DEF_CFA            0x0c
+#define CFA_DEF_CFA_REGISTER   0x0d
+#define CFA_DEF_CFA_OFFSET     0x0e
+#define CFA_DEF_CFA_EXPRESSION 0x0f
+#define CFA_EXPRESSION         0x10
+#define CFA_OFFSET_EXTENDED_SF 0x11
+#define CFA_DEF_CFA_SF         0x12
+#define CFA_DEF_CFA_OFFSET_SF  0x13
+#define CFA_VAL_OFFSET         0x14
+#define CFA_VAL_OFFSET_SF      0x15
+#define CFA_VAL_EXPRESSION     0x16
+#define CFA_GNU_ARGS_SIZE      0x2e
+#define CFA_GNU_NEGATIVE_OFFSET_EXTENDED 0x2f
+
+// Reads the fields of a call frame information section. Reading past the
+//   end of the section returns zeros and clears ok.
+struct cfi_reader {
+  const char* data; // Section contents
+  size_t size;      // Section size
+  uint64_t addr;    // File-relative address of the section
+  size_t pos;       // Offset of the next field
+  bool ok;          // Whether every read was within the section
+
+  /**
+  * read a fixed-size field
+  * @param  len the size of the field, at most 8 bytes
+  * @return     the field's value
+  */
+  uint64_t fixed(size_t len) {
+    uint64_t value = 0;
+    if (len > size - std::min(pos, size)) {
+      ok = false;
+      pos = size;
+      return 0;
+    }
+    memcpy(&value, data + pos, len);
+    pos += len;
+    return value;
+  }
+
+  /**
+  * @return the value of an unsigned LEB128 field
+  */
+  uint64_t uleb() {
+    uint64_t value = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+      byte = fixed(1);
+      if (shift < 64) {
+        value |= (uint64_t)(byte & 0x7f) << shift;
+      }
+      shift += 7;
+    } while (ok && (byte & 0x80));
+    return value;
+  }
+
+  /**
+  * @return the value of a signed LEB128 field
+  */
+  int64_t sleb() {
+    int64_t value = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+      byte = fixed(1);
+      if (shift < 64) {
+        value |= (int64_t)(byte & 0x7f) << shift;
+      }
+      shift += 7;
+    } while (ok && (byte & 0x80));
+    if (shift < 64 && (byte & 0x40)) {
+      value |= -((int64_t)1 << shift);
+    }
+    return value;
+  }
+
+  /**
+  * read an encoded pointer
+  * @param  encoding the pointer's DW_EH_PE encoding
+  * @param  apply    whether to apply the encoding's base, e.g. the address
+  *                  of the field for pc-relative pointers
+  * @return          the pointer's value
+  */
+  uint64_t pointer(uint8_t encoding, bool apply) {
+    uint64_t field = addr + pos;
+    uint64_t value;
+    switch (encoding & PE_FORMAT) {
+      case PE_ABSPTR:  value = fixed(8); break;
+      case PE_ULEB128: value = uleb(); break;
+      case PE_UDATA2:  value = fixed(2); break;
+      case PE_UDATA4:  value = fixed(4); break;
+      case PE_UDATA8:  value = fixed(8); break;
+      case PE_SLEB128: value = sleb(); break;
+      case PE_SDATA2:  value = (int16_t)fixed(2); break;
+      case PE_SDATA4:  value = (int32_t)fixed(4); break;
+      case PE_SDATA8:  value = fixed(8); break;
+      default:
+        ok = false;
+        return 0;
+    }
+    if (apply && (encoding & PE_APPLY) == PE_PCREL) {
+      value += field;
+    } else if (apply && (encoding & PE_APPLY) != 0) {
+      // Bases other than the field's address are not used on x86-64
+      ok = false;
+    }
+    return value;
+  }
+};
+
+// The rules of the registers needed to unwind, at one address
+struct cfi_state {
+  frame_rule cfa_rule;
+  uint8_t cfa_reg;
+  int64_t cfa_offset;
+  frame_rule ra_rule;
+  int64_t ra_offset;
+  frame_rule rbp_rule;
+  int64_t rbp_offset;
+};
+
+// A decoded CIE, shared by the FDEs that point to it
+struct cfi_cie {
+  uint64_t code_align;       // Factor of location advances
+  int64_t data_align;        // Factor of register offsets
+  uint64_t ra_reg;           // Register holding the return address
+  uint8_t fde_encoding;      // Encoding of the FDEs' addresses
+  bool augmented;            // Whether FDEs have augmentation data
+  size_t program;            // Offset of the initial instructions
+  size_t program_end;        // End of the initial instructions
+  bool ok;                   // Whether the CIE could be decoded
+};
+
+/**
+* decode the CIE at an offset of a section
+* @param  section the section, whose position is left unchanged
+* @param  offset  the offset of the CIE's length field
+* @param  eh_frame true for .eh_frame, false for .debug_frame
+* @return          the decoded CIE
+*/
+static cfi_cie read_cie(cfi_reader section, size_t offset, bool eh_frame) {
+  cfi_cie cie {};
+  cfi_reader r = section;
+  r.pos = offset;
+  r.ok = true;
+
+  uint64_t length = r.fixed(4);
+  bool dwarf64 = length == 0xffffffff;
+  if (dwarf64) {
+    length = r.fixed(8);
+  }
+  size_t end = r.pos + length;
+  uint64_t id = r.fixed(dwarf64 && !eh_frame ? 8 : 4);
+  if (!r.ok || end > r.size || id != (eh_frame ? 0 : dwarf64 ? ~0ULL : 0xffffffffULL)) {
+    return cie;
+  }
+
+  uint8_t version = r.fixed(1);
+  std::string augmentation;
+  for (char c = r.fixed(1); r.ok && c != '\0'; c = r.fixed(1)) {
+    augmentation += c;
+  }
+  if (version >= 4) {
+    // Address and segment selector sizes
+    r.fixed(2);
+  }
+  cie.code_align = r.uleb();
+  cie.data_align = r.sleb();
+  cie.ra_reg = version == 1 ? r.fixed(1) : r.uleb();
+  cie.fde_encoding = eh_frame ? PE_ABSPTR : PE_UDATA8;
+
+  // Augmentations other than "z..." have no length to skip them by
+  if (!augmentation.empty()) {
+    if (augmentation[0] != 'z') {
+      return cie;
+    }
+    cie.augmented = true;
+    uint64_t aug_length = r.uleb();
+    size_t aug_end = r.pos + aug_length;
+    for (size_t i = 1; i < augmentation.size() && r.ok; i++) {
+      switch (augmentation[i]) {
+        case 'R':
+          cie.fde_encoding = r.fixed(1);
+          break;
+        case 'P': {
+          uint8_t encoding = r.fixed(1);
+          r.pointer(encoding, false);
+          break;
+        }
+        case 'L':
+          r.fixed(1);
+          break;
+        default:
+          break;
+      }
+    }
+    r.pos = aug_end;
+  }
+
+  cie.program = r.pos;
+  cie.program_end = end;
+  cie.ok = r.ok && r.pos <= end;
+  return cie;
+}
+
+/**
+* run call frame instructions, adding a row each time the location advances
+* @param r         the section, positioned at the first instruction
+* @param end       the end of the instructions
+* @param cie       the CIE of the instructions
+* @param initial   the rules after the CIE's initial instructions
+* @param state     the rules, updated by the instructions
+* @param loc       the current location, updated by the instructions
+* @param fde_end   the end of the FDE's function, or 0 for the CIE's
+*                  initial instructions, which add no rows
+* @param rows      the rows to add to
+* @return          false if an instruction could not be decoded
+*/
+static bool run_program(cfi_reader &r, size_t end, const cfi_cie &cie, const cfi_state &initial,
+                        cfi_state &state, uint64_t &loc, uint64_t fde_end,
+                        std::vector<frame_row> &rows) {
+  std::vector<cfi_state> remembered;
+
+  // The rules of a register, if it is one that is tracked
+  auto rule_of = [&](uint64_t reg, frame_rule *&rule, int64_t *&offset) {
+    if (reg == DWARF_REG_RBP) {
+      rule = &state.rbp_rule;
+      offset = &state.rbp_offset;
+    } else if (reg == cie.ra_reg) {
+      rule = &state.ra_rule;
+      offset = &state.ra_offset;
+    } else {
+      rule = nullptr;
+      offset = nullptr;
+    }
+  };
+  auto set_rule = [&](uint64_t reg, frame_rule value, int64_t off) {
+    frame_rule *rule;
+    int64_t *offset;
+    rule_of(reg, rule, offset);
+    if (rule != nullptr) {
+      *rule = value;
+      *offset = off;
+    }
+  };
+  auto restore = [&](uint64_t reg) {
+    if (reg == DWARF_REG_RBP) {
+      state.rbp_rule = initial.rbp_rule;
+      state.rbp_offset = initial.rbp_offset;
+    } else if (reg == cie.ra_reg) {
+      state.ra_rule = initial.ra_rule;
+      state.ra_offset = initial.ra_offset;
+    }
+  };
+  auto advance = [&](uint64_t to) {
+    if (fde_end != 0 && to > loc) {
+      rows.push_back(frame_row{loc, fde_end, state.cfa_rule, state.cfa_reg, state.ra_rule,
+                               state.rbp_rule, (int32_t)state.cfa_offset,
+                               (int32_t)state.ra_offset, (int32_t)state.rbp_offset});
+    }
+    loc = to;
+  };
+
+  while (r.ok && r.pos < end) {
+    uint8_t op = r.fixed(1);
+    uint8_t operand = op & 0x3f;
+    switch (op & 0xc0) {
+      case CFA_ADVANCE_LOC:
+        advance(loc + operand * cie.code_align);
+        continue;
+      case CFA_OFFSET:
+        set_rule(operand, frame_rule::OFFSET, (int64_t)r.uleb() * cie.data_align);
+        continue;
+      case CFA_RESTORE:
+        restore(operand);
+        continue;
+      default:
+        break;
+    }
+
+    switch (op) {
+      case CFA_NOP:
+        break;
+      case CFA_SET_LOC:
+        advance(r.pointer(cie.fde_encoding, true));
+        break;
+      case CFA_ADVANCE_LOC1:
+        advance(loc + r.fixed(1) * cie.code_align);
+        break;
+      case CFA_ADVANCE_LOC2:
+        advance(loc + r.fixed(2) * cie.code_align);
+        break;
+      case CFA_ADVANCE_LOC4:
+        advance(loc + r.fixed(4) * cie.code_align);
+        break;
+      case CFA_OFFSET_EXTENDED: {
+        uint64_t reg = r.uleb();
+        set_rule(reg, frame_rule::OFFSET, (int64_t)r.uleb() * cie.data_align);
+        break;
+      }
+      case CFA_OFFSET_EXTENDED_SF: {
+        uint64_t reg = r.uleb();
+        set_rule(reg, frame_rule::OFFSET, r.sleb() * cie.data_align);
+        break;
+      }
+      case CFA_GNU_NEGATIVE_OFFSET_EXTENDED: {
+        uint64_t reg = r.uleb();
+        set_rule(reg, frame_rule::OFFSET, -(int64_t)r.uleb() * cie.data_align);
+        break;
+      }
+      case CFA_RESTORE_EXTENDED:
+        restore(r.uleb());
+        break;
+      case CFA_UNDEFINED:
+        set_rule(r.uleb(), frame_rule::UNDEFINED, 0);
+        break;
+      case CFA_SAME_VALUE:
+        set_rule(r.uleb(), frame_rule::SAME, 0);
+        break;
+      case CFA_REGISTER: {
+        // Kept in another register, which is not tracked
+        uint64_t reg = r.uleb();
+        r.uleb();
+        set_rule(reg, frame_rule::EXPRESSION, 0);
+        break;
+      }
+      case CFA_REMEMBER_STATE:
+        remembered.push_back(state);
+        break;
+      case CFA_RESTORE_STATE:
+        // The CFA is restored too, as compilers expect after an epilogue
+        //   in the middle of a function
+        if (!remembered.empty()) {
+          state = remembered.back();
+          remembered.pop_back();
+        }
+        break;
+      case CFA_DEF_CFA:
+        state.cfa_rule = frame_rule::REGISTER;
+        state.cfa_reg = r.uleb();
+        state.cfa_offset = r.uleb();
+        break;
+      case CFA_DEF_CFA_SF:
+        state.cfa_rule = frame_rule::REGISTER;
+        state.cfa_reg = r.uleb();
+        state.cfa_offset = r.sleb() * cie.data_align;
+        break;
+      case CFA_DEF_CFA_REGISTER:
+        state.cfa_rule = frame_rule::REGISTER;
+        state.cfa_reg = r.uleb();
+        break;
+      case CFA_DEF_CFA_OFFSET:
+        state.cfa_offset = r.uleb();
+        break;
+      case CFA_DEF_CFA_OFFSET_SF:
+        state.cfa_offset = r.sleb() * cie.data_align;
+        break;
+      case CFA_DEF_CFA_EXPRESSION:
+        state.cfa_rule = frame_rule::EXPRESSION;
+        r.pos += r.uleb();
+        break;
+      case CFA_EXPRESSION:
+      case CFA_VAL_EXPRESSION: {
+        uint64_t reg = r.uleb();
+        r.pos += r.uleb();
+        set_rule(reg, frame_rule::EXPRESSION, 0);
+        break;
+      }
+      case CFA_VAL_OFFSET: {
+        uint64_t reg = r.uleb();
+        r.uleb();
+        set_rule(reg, frame_rule::EXPRESSION, 0);
+        break;
+      }
+      case CFA_VAL_OFFSET_SF: {
+        uint64_t reg = r.uleb();
+        r.sleb();
+        set_rule(reg, frame_rule::EXPRESSION, 0);
+        break;
+      }
+      case CFA_GNU_ARGS_SIZE:
+        r.uleb();
+        break;
+      default:
+        return false;
+    }
+  }
+  return r.ok;
+}
+
+/**
+* decode a call frame information section
+* @param data     the section's contents
+* @param size     the section's size
+* @param addr     the file-relative address the section is loaded at
+* @param eh_frame true for .eh_frame, false for .debug_frame
+*/
+void frame_table::add_section(const char* data, size_t size, uint64_t addr, bool eh_frame) {
+  cfi_reader section {data, size, addr, 0, true};
+  std::unordered_map<size_t, cfi_cie> cies;
+
+  size_t offset = 0;
+  while (offset + 4 <= size) {
+    cfi_reader r = section;
+    r.pos = offset;
+    uint64_t length = r.fixed(4);
+    bool dwarf64 = length == 0xffffffff;
+    if (dwarf64) {
+      length = r.fixed(8);
+    }
+    // A zero length ends .eh_frame
+    if (length == 0 || !r.ok) {
+      break;
+    }
+    size_t end = r.pos + length;
+    if (end > size || end < r.pos) {
+      break;
+    }
+    offset = end;
+
+    size_t id_pos = r.pos;
+    uint64_t id = r.fixed(dwarf64 && !eh_frame ? 8 : 4);
+    bool is_cie = eh_frame ? id == 0 : id == (dwarf64 ? ~0ULL : 0xffffffffULL);
+    if (is_cie) {
+      continue;
+    }
+
+    // .eh_frame FDEs point back to their CIE, .debug_frame FDEs give its offset
+    size_t cie_offset = eh_frame ? id_pos - id : id;
+    auto it = cies.find(cie_offset);
+    if (it == cies.end()) {
+      it = cies.emplace(cie_offset, read_cie(section, cie_offset, eh_frame)).first;
+    }
+    const cfi_cie &cie = it->second;
+    if (!cie.ok) {
+      continue;
+    }
+
+    uint64_t start = r.pointer(cie.fde_encoding, true);
+    uint64_t range = r.pointer(cie.fde_encoding & PE_FORMAT, false);
+    if (cie.augmented) {
+      r.pos += r.uleb();
+    }
+    if (!r.ok || range == 0 || start == 0) {
+      continue;
+    }
+
+    // The CIE's initial instructions give the rules at the function's entry
+    cfi_state initial {frame_rule::UNDEFINED, 0, 0, frame_rule::UNDEFINED, 0, frame_rule::SAME, 0};
+    cfi_reader program = section;
+    program.pos = cie.program;
+    uint64_t loc = start;
+    std::vector<frame_row> unused;
+    if (!run_program(program, cie.program_end, cie, initial, initial, loc, 0, unused)) {
+      continue;
+    }
+    cfi_state state = initial;
+    size_t first = rows.size();
+    loc = start;
+    if (run_program(r, end, cie, initial, state, loc, start + range, rows)) {
+      rows.push_back(frame_row{loc, start + range, state.cfa_rule, state.cfa_reg, state.ra_rule,
+                               state.rbp_rule, (int32_t)state.cfa_offset,
+                               (int32_t)state.ra_offset, (int32_t)state.rbp_offset});
+    } else {
+      rows.resize(first);
+    }
+  }
+}
+
+/**
+* sort the rows, once every section was added
+*/
+void frame_table::finish() {
+  // Stable, so that the last row of an FDE at an address is the one found
+  std::stable_sort(rows.begin(), rows.end(),
+                   [](const frame_row &a, const frame_row &b) { return a.start < b.start; });
+  rows.shrink_to_fit();
+}
+
+/**
+* find the row covering an address
+* @param  addr a file-relative address
+* @param  row  set to the row
+* @return      true if a row was found, false otherwise
+*/
+bool frame_table::find(uint64_t addr, frame_row &row) const {
+  auto it = std::upper_bound(rows.begin(), rows.end(), addr,
+                             [](uint64_t a, const frame_row &r) { return a < r.start; });
+  if (it == rows.begin() || addr >= (it - 1)->end) {
+    return false;
+  }
+  row = *(it - 1);
+  return true;
+}
@@ -0,0 +1,77 @@
+#ifndef _FRAME_TABLE_HH_
+#define _FRAME_TABLE_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <vector>
+
+// DWARF numbers of the x86-64 registers used to unwind
+#define DWARF_REG_RBP 6
+#define DWARF_REG_RSP 7
+#define DWARF_REG_RA  16
+
+// How to find the caller's value of a register, or the CFA
+enum class frame_rule : uint8_t {
+  UNDEFINED, // Not recoverable, e.g. the return address of the outermost frame
+  SAME,      // Not changed by the function
+  OFFSET,    // Saved at an offset from the CFA
+  REGISTER,  // The CFA is a register plus an offset
+  EXPRESSION // Computed by a DWARF expression, which is not evaluated
+};
+
+// How to unwind one frame, for a range of instructions
+struct frame_row {
+  uint64_t start;      // First file-relative address the row applies to
+  uint64_t end;        // End (exclusive) of the function the row belongs to
+  frame_rule cfa_rule; // REGISTER or EXPRESSION
+  uint8_t cfa_reg;     // Register the CFA is computed from
+  frame_rule ra_rule;  // Rule of the return address
+  frame_rule rbp_rule; // Rule of the caller's frame pointer
+  int32_t cfa_offset;  // Offset of the CFA from cfa_reg
+  int32_t ra_offset;   // Offset of the return address from the CFA
+  int32_t rbp_offset;  // Offset of the saved frame pointer from the CFA
+};
+
+/**
+ * The call frame information (CFI) of a file, decoded from its .eh_frame
+ *   and .debug_frame sections. The programs of every FDE are run once, and
+ *   the rows they produce for the registers needed to unwind x86-64 stacks
+ *   are kept sorted by address, so that unwinding a frame is a binary
+ *   search.
+ */
+class frame_table {
+public:
+
+  /**
+  * decode a call frame information section
+  * @param data     the section's contents
+  * @param size     the section's size
+  * @param addr     the file-relative address the section is loaded at
+  * @param eh_frame true for .eh_frame, false for .debug_frame
+  */
+  void add_section(const char* data, size_t size, uint64_t addr, bool eh_frame);
+
+  /**
+  * sort the rows, once every section was added
+  */
+  void finish();
+
+  /**
+  * find the row covering an address
+  * @param  addr a file-relative address
+  * @param  row  set to the row
+  * @return      true if a row was found, false otherwise
+  */
+  bool find(uint64_t addr, frame_row &row) const;
+
+  /**
+  * @return the number of rows
+  */
+  auto size() const -> size_t { return rows.size(); }
+
+private:
+  std::vector<frame_row> rows; // Rows of every FDE, sorted by start
+};
+
+#endif /* _FRAME_TABLE_HH_ */
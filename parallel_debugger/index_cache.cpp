@@ -0,0 +1,131 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <functional>
+#include <string>
+
+#include "index_cache.hh"
+
+// Note type of the GNU build-id note
+#define NT_GNU_BUILD_ID 3
+
+// Header of an ELF note, followed by the 4-byte aligned name and descriptor
+struct note_header {
+  uint32_t namesz;
+  uint32_t descsz;
+  uint32_t type;
+};
+
+/**
+* create a directory and all of its missing parents
+* @param  dir the directory path
+* @return     true if the directory exists when the function returns
+*/
+static bool make_dirs(const std::string &dir) {
+  for (size_t pos = 1; pos <= dir.size(); pos++) {
+    if (pos == dir.size() || dir[pos] == '/') {
+      std::string prefix = dir.substr(0, pos);
+      if (mkdir(prefix.c_str(), 0755) == -1 && errno != EEXIST) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+* get the directory holding the cached index files
+* @return the directory path, or an empty string if the cache is disabled
+*/
+static std::string cache_dir() {
+  const char* dir = getenv("PARALLEL_DEBUGGER_CACHE");
+  if (dir != NULL) {
+    return dir;
+  }
+  dir = getenv("XDG_CACHE_HOME");
+  if (dir != NULL && dir[0] != '\0') {
+    return std::string(dir) + "/parallel_debugger";
+  }
+  dir = getenv("HOME");
+  if (dir != NULL && dir[0] != '\0') {
+    return std::string(dir) + "/.cache/parallel_debugger";
+  }
+  return "";
+}
+
+/**
+* get the GNU build-id of an ELF file
+* @param  f the parsed ELF file
+* @return   the build-id as a hexadecimal string, or an empty string if the
+*           file has no build-id note
+*/
+std::string elf_build_id(const elf::elf &f) {
+  for (auto &sec : f.sections()) {
+    if (sec.get_hdr().type != elf::sht::note) {
+      continue;
+    }
+
+    // Walk the notes of this section
+    auto data = static_cast<const char*>(sec.data());
+    size_t size = sec.size();
+    size_t pos = 0;
+    while (pos + sizeof(note_header) <= size) {
+      auto note = reinterpret_cast<const note_header*>(data + pos);
+      size_t name_pos = pos + sizeof(note_header);
+      size_t desc_pos = name_pos + ((note->namesz + 3) & ~3u);
+      size_t next = desc_pos + ((note->descsz + 3) & ~3u);
+      if (next > size) {
+        break;
+      }
+      if (note->type == NT_GNU_BUILD_ID && note->namesz == 4
+          && memcmp(data + name_pos, "GNU", 4) == 0) {
+        std::string id;
+        char hex[3];
+        for (size_t i = 0; i < note->descsz; i++) {
+          snprintf(hex, sizeof(hex), "%02x", (unsigned char)data[desc_pos + i]);
+          id += hex;
+        }
+        return id;
+      }
+      pos = next;
+    }
+  }
+  return "";
+}
+
+/**
+* get the path of the cached index file for an ELF file. Files are keyed by
+*   their GNU build-id, or by their path, modification time and size if they
+*   have none.
+* @param  f         the parsed ELF file
+* @param  file_path the absolute path of the ELF file
+* @return           the path of the index file, or an empty string if the
+*                   cache is disabled or its directory cannot be created
+*/
+std::string index_cache_path(const elf::elf &f, const std::string &file_path) {
+  std::string dir = cache_dir();
+  if (dir.empty() || !make_dirs(dir)) {
+    return "";
+  }
+
+  std::string key = elf_build_id(f);
+  if (key.empty()) {
+    // No build-id: fall back to the file's identity on disk
+    struct stat st;
+    if (stat(file_path.c_str(), &st) == -1) {
+      return "";
+    }
+    std::string id = file_path + ":" + std::to_string(st.st_mtime) + ":"
+      + std::to_string(st.st_size);
+    char hex[32];
+    snprintf(hex, sizeof(hex), "%016zx", std::hash<std::string>()(id));
+    key = std::string("path-") + hex;
+  }
+
+  return dir + "/" + key + ".idx";
+}
@@ -0,0 +1,33 @@
+#ifndef _INDEX_CACHE_HH_
+#define _INDEX_CACHE_HH_
+
+#include <string>
+
+#include "elf++.hh"
+
+/**
+ * The on-disk cache of line indexes lives in $PARALLEL_DEBUGGER_CACHE, or in
+ *   $XDG_CACHE_HOME/parallel_debugger, or in ~/.cache/parallel_debugger.
+ *   Setting PARALLEL_DEBUGGER_CACHE to an empty string disables the cache.
+ */
+
+/**
+* get the path of the cached index file for an ELF file. Files are keyed by
+*   their GNU build-id, or by their path, modification time and size if they
+*   have none.
+* @param  f         the parsed ELF file
+* @param  file_path the absolute path of the ELF file
+* @return           the path of the index file, or an empty string if the
+*                   cache is disabled or its directory cannot be created
+*/
+std::string index_cache_path(const elf::elf &f, const std::string &file_path);
+
+/**
+* get the GNU build-id of an ELF file
+* @param  f the parsed ELF file
+* @return   the build-id as a hexadecimal string, or an empty string if the
+*           file has no build-id note
+*/
+std::string elf_build_id(const elf::elf &f);
+
+#endif /* _INDEX_CACHE_HH_ */
@@ -0,0 +1,200 @@
+#include <limits.h>
+#include <link.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "library_tracker.hh"
+#include "process_memory.hh"
+
+// Entries of the dynamic linker's list followed at most, in case it is
+//   corrupted
+#define MAX_LINK_MAPS 4096
+
+// Bytes of a library's name read at once
+#define NAME_CHUNK_SIZE 256
+
+/**
+* read a NUL-terminated string of the traced process
+* @param  tid  a stopped thread of the traced process
+* @param  addr the address of the string
+* @param  str  set to the string
+* @return      true if the whole string was read, false otherwise
+*/
+static bool read_string(pid_t tid, intptr_t addr, std::string &str) {
+  str.clear();
+  char chunk[NAME_CHUNK_SIZE];
+  while (str.size() < PATH_MAX) {
+    // Chunks are aligned, so they never cross into a page that may not be
+    //   mapped
+    size_t len = NAME_CHUNK_SIZE - (addr % NAME_CHUNK_SIZE);
+    if (!read_memory(tid, addr, chunk, len)) {
+      return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+      if (chunk[i] == '\0') {
+        str.append(chunk, i);
+        return true;
+      }
+    }
+    str.append(chunk, len);
+    addr += len;
+  }
+  return false;
+}
+
+/**
+* insert a breakpoint on the dynamic linker's hook, and add the libraries
+*   loaded since the index was built. The dynamic linker sets up r_debug
+*   before running the program, so this is done at main.
+* @param  pid     the traced process, stopped
+* @param  objects the shared objects the index was built from
+* @return         true if the dynamic linker was found, false otherwise,
+*                 e.g. for static executables
+*/
+bool library_tracker::attach(pid_t pid, std::vector<shared_obj> &objects) {
+  for (auto &obj : objects) {
+    initial.insert(library_key{obj.obj_off_to_sys_mem(0), obj.get_path()});
+    uint64_t file_addr;
+    if (r_debug_addr == 0 && obj.get_info()->find_object_symbol("_r_debug", file_addr)) {
+      r_debug_addr = obj.obj_off_to_sys_mem(file_addr);
+    }
+  }
+
+  struct r_debug debug;
+  if (r_debug_addr == 0 || !read_memory(pid, r_debug_addr, &debug, sizeof(debug))
+      || debug.r_brk == 0) {
+    r_debug_addr = 0;
+    return false;
+  }
+  hook = debug.r_brk;
+  breakpoints.insert(hook);
+  breakpoints.flush();
+
+  update(pid);
+  return true;
+}
+
+/**
+* check whether a SIGTRAP stop of a thread is at the dynamic linker's
+*   hook. The thread's instruction pointer is left after the breakpoint,
+*   like the other users of the breakpoints expect.
+* @param  tid the stopped thread
+* @return     true if the thread executed the hook's breakpoint, false
+*             otherwise
+*/
+bool library_tracker::handle_stop(pid_t tid) {
+  if (hook == 0 || regs.get_ip(tid) - 1 != hook) {
+    return false;
+  }
+  // Only a breakpoint instruction is reported with SI_KERNEL
+  siginfo_t info;
+  ptrace(PTRACE_GETSIGINFO, tid, NULL, &info);
+  return info.si_signo == SIGTRAP && info.si_code == SI_KERNEL;
+}
+
+/**
+* apply the libraries added and removed since the last update to the
+*   index, if the dynamic linker's list of loaded objects is consistent
+* @param  tid a stopped thread of the traced process
+* @return     true if the index changed, false otherwise
+*/
+bool library_tracker::update(pid_t tid) {
+  // The hook is called before and after each change. Before, the list
+  //   may be half-built, and the objects being removed are still mapped.
+  struct r_debug debug;
+  if (!read_memory(tid, r_debug_addr, &debug, sizeof(debug))
+      || debug.r_state != r_debug::RT_CONSISTENT) {
+    return false;
+  }
+
+  std::set<library_key> loaded;
+  bool changed = false;
+  intptr_t next = (intptr_t)debug.r_map;
+  for (size_t n = 0; next != 0 && n < MAX_LINK_MAPS; n++) {
+    struct link_map map;
+    if (!read_memory(tid, next, &map, sizeof(map))) {
+      break;
+    }
+    next = (intptr_t)map.l_next;
+
+    // The main executable has an empty name, and the vDSO has no file
+    std::string name;
+    if (!read_string(tid, (intptr_t)map.l_name, name) || name.empty()) {
+      continue;
+    }
+    // Names are as the program gave them, so relative to its directory,
+    //   and possibly through symbolic links, unlike the maps file's paths
+    if (name[0] != '/') {
+      name = "/proc/" + std::to_string(tid) + "/cwd/" + name;
+    }
+    char path[PATH_MAX];
+    struct stat st;
+    if (realpath(name.c_str(), path) == NULL || stat(path, &st) == -1) {
+      continue;
+    }
+
+    library_key key {(intptr_t)map.l_addr, path};
+    if (initial.count(key)) {
+      continue;
+    }
+    loaded.insert(key);
+    if (libraries.count(key)) {
+      continue;
+    }
+    auto info = cache.get(path, ((unsigned long)major(st.st_dev) << 32) | minor(st.st_dev),
+                          st.st_ino);
+    if (info) {
+      add_library(key, info);
+      changed = true;
+    }
+  }
+
+  // Libraries no longer in the list were unloaded
+  for (auto it = libraries.begin(); it != libraries.end(); ) {
+    if (loaded.count(it->first)) {
+      ++it;
+      continue;
+    }
+    for (auto &obj : it->second) {
+      index.erase(&obj);
+      if (writer != nullptr) {
+        writer->unmap(obj);
+      }
+    }
+    it = libraries.erase(it);
+    changed = true;
+  }
+  return changed;
+}
+
+/**
+* add the mappings of a newly loaded library to the index
+* @param key  the library's load bias and path
+* @param info the library file's debugging information
+*/
+void library_tracker::add_library(const library_key &key,
+                                  const std::shared_ptr<debug_info> &info) {
+  std::vector<load_segment> segments;
+  info->get_load_segments(segments);
+
+  // The mappings are built before being indexed, since the index keeps
+  //   pointers to them
+  std::vector<shared_obj> &mappings = libraries[key];
+  for (auto &seg : segments) {
+    mappings.push_back(shared_obj{info, (intptr_t)(key.first + seg.start),
+                                  (intptr_t)(key.first + seg.end), seg.offset});
+  }
+  for (auto &obj : mappings) {
+    index.insert(&obj);
+    if (writer != nullptr) {
+      writer->map(obj);
+    }
+  }
+}
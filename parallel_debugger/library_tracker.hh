@@ -0,0 +1,109 @@
+#ifndef _LIBRARY_TRACKER_HH_
+#define _LIBRARY_TRACKER_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "breakpoint_manager.hh"
+#include "debug_info.hh"
+#include "object_index.hh"
+#include "register_cache.hh"
+#include "shared_object.hh"
+#include "trace_file.hh"
+
+/**
+ * Keeps the object index in step with the libraries the dynamic linker
+ *   loads and unloads, e.g. with dlopen and dlclose. The dynamic linker
+ *   calls a hook function, whose address it publishes in its r_debug
+ *   structure, before and after each change of its list of loaded objects.
+ *   A breakpoint on the hook stops the thread making the change; once the
+ *   list is consistent again, it is walked and compared with the libraries
+ *   already known, and only the mappings of the libraries added or removed
+ *   are inserted in or erased from the index. New mappings are computed
+ *   from the program headers of the library's file, instead of reading the
+ *   maps file again.
+ */
+class library_tracker {
+public:
+
+  /**
+  * construct a new library tracker
+  * @param index       the address index of the traced process' shared objects
+  * @param cache       the files already parsed, shared with the index
+  * @param regs        the registers of the traced threads
+  * @param breakpoints the breakpoints of the traced process
+  * @param writer      the binary trace to record the mapping changes in, or
+  *                    nullptr
+  */
+  library_tracker(object_index &index, debug_info_cache &cache, register_cache &regs,
+                  breakpoint_manager &breakpoints, trace_writer *writer)
+  : index(index), cache(cache), regs(regs), breakpoints(breakpoints), writer{writer},
+    r_debug_addr{0}, hook{0}
+  {}
+
+  /**
+  * insert a breakpoint on the dynamic linker's hook, and add the libraries
+  *   loaded since the index was built. The dynamic linker sets up r_debug
+  *   before running the program, so this is done at main.
+  * @param  pid     the traced process, stopped
+  * @param  objects the shared objects the index was built from
+  * @return         true if the dynamic linker was found, false otherwise,
+  *                 e.g. for static executables
+  */
+  bool attach(pid_t pid, std::vector<shared_obj> &objects);
+
+  /**
+  * check whether a SIGTRAP stop of a thread is at the dynamic linker's
+  *   hook. The thread's instruction pointer is left after the breakpoint,
+  *   like the other users of the breakpoints expect.
+  * @param  tid the stopped thread
+  * @return     true if the thread executed the hook's breakpoint, false
+  *             otherwise
+  */
+  bool handle_stop(pid_t tid);
+
+  /**
+  * apply the libraries added and removed since the last update to the
+  *   index, if the dynamic linker's list of loaded objects is consistent
+  * @param  tid a stopped thread of the traced process
+  * @return     true if the index changed, false otherwise
+  */
+  bool update(pid_t tid);
+
+  /**
+  * @return the address of the dynamic linker's hook, 0 if not attached
+  */
+  auto get_hook() const -> intptr_t { return hook; }
+
+private:
+  // A library loaded after the index was built, identified by its load
+  //   bias and path
+  typedef std::pair<intptr_t, std::string> library_key;
+
+  /**
+  * add the mappings of a newly loaded library to the index
+  * @param key  the library's load bias and path
+  * @param info the library file's debugging information
+  */
+  void add_library(const library_key &key, const std::shared_ptr<debug_info> &info);
+
+  object_index &index;                  // Address index of the shared objects
+  debug_info_cache &cache;              // Files already parsed
+  register_cache &regs;                 // Registers of the traced threads
+  breakpoint_manager &breakpoints;      // Breakpoints of the traced process
+  trace_writer *writer;                 // Binary trace, if any
+  intptr_t r_debug_addr;                // Address of the dynamic linker's r_debug
+  intptr_t hook;                        // Address of the dynamic linker's hook
+  std::set<library_key> initial;        // Libraries of the objects the index was built from
+  std::map<library_key, std::vector<shared_obj>> libraries; // Mappings of each added library
+};
+
+#endif /* _LIBRARY_TRACKER_HH_ */
@@ -0,0 +1,214 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "line_coverage.hh"
+#include "process_memory.hh"
+
+/**
+* write the original byte back over a breakpoint, in the memory of the
+*   process of a stopped thread
+* @param tid  the stopped thread
+* @param addr the breakpoint address
+* @param byte the original byte
+*/
+static void restore_byte(pid_t tid, intptr_t addr, uint8_t byte) {
+  // An aligned word never crosses into a page that may not be mapped
+  intptr_t base = addr & ~(intptr_t)(sizeof(long) - 1);
+  errno = 0;
+  long word = ptrace(PTRACE_PEEKTEXT, tid, base, NULL);
+  if (errno != 0) {
+    return;
+  }
+  memcpy(reinterpret_cast<uint8_t*>(&word) + (addr - base), &byte, 1);
+  ptrace(PTRACE_POKETEXT, tid, base, word);
+}
+
+/**
+* insert a breakpoint at each statement row of the objects with debug
+*   information
+* @param  objects the mapped objects of the traced process, stopped
+* @return         the number of source lines with a breakpoint
+*/
+size_t line_coverage::attach(std::vector<shared_obj> &objects) {
+  std::vector<line_info> rows;
+  std::vector<uint8_t> code;
+  for (auto &obj : objects) {
+    if (!obj.has_cus()) {
+      continue;
+    }
+    rows.clear();
+    obj.get_info()->get_line_rows(obj.sys_mem_to_obj_off(obj.get_start()),
+                                  obj.sys_mem_to_obj_off(obj.get_end()), rows);
+    if (rows.empty()) {
+      continue;
+    }
+
+    // Save the original code of the mapping's rows in a single read, for
+    //   the forked processes. Rows are sorted by address.
+    intptr_t first = obj.obj_off_to_sys_mem(rows.front().address);
+    code.resize(obj.obj_off_to_sys_mem(rows.back().address) - first + 1);
+    if (!read_memory(pid, first, code.data(), code.size())) {
+      continue;
+    }
+
+    for (auto &row : rows) {
+      intptr_t addr = obj.obj_off_to_sys_mem(row.address);
+      // Line 0 marks code that belongs to no line
+      if (!row.is_stmt || row.line == 0 || sites.count(addr)) {
+        continue;
+      }
+      auto key = std::make_pair(row.file, row.line);
+      auto it = line_ids.find(key);
+      if (it == line_ids.end()) {
+        it = line_ids.emplace(key, lines.size()).first;
+        lines.push_back(source_line{row.file, row.line, false});
+      }
+      sites.emplace(addr, site{it->second, code[addr - first], false});
+      breakpoints.insert(addr);
+    }
+  }
+  breakpoints.flush();
+  return lines.size();
+}
+
+/**
+* record the lines of a range of code as executed, e.g. the code run
+*   before the breakpoints were inserted, removing their breakpoints
+* @param low  the first address of the range
+* @param high the end address (exclusive) of the range
+*/
+void line_coverage::mark_executed(intptr_t low, intptr_t high) {
+  for (auto &entry : sites) {
+    if (entry.first >= low && entry.first < high) {
+      hit(entry.first, entry.second);
+    }
+  }
+}
+
+/**
+* check whether a SIGTRAP stop of a thread is at one of the breakpoints,
+*   and if so record its line and move the thread back onto the original
+*   instruction
+* @param  tid the stopped thread
+* @return     true if the thread executed one of the breakpoints, false
+*             otherwise
+*/
+bool line_coverage::handle_stop(pid_t tid) {
+  // Several threads may reach a breakpoint before it is removed, so the
+  //   address is looked up even if the breakpoint was already hit
+  intptr_t addr = regs.get_ip(tid) - 1;
+  auto it = sites.find(addr);
+  if (it == sites.end()) {
+    return false;
+  }
+  // Only a breakpoint instruction is reported with SI_KERNEL
+  siginfo_t info;
+  ptrace(PTRACE_GETSIGINFO, tid, NULL, &info);
+  if (info.si_signo != SIGTRAP || info.si_code != SI_KERNEL) {
+    return false;
+  }
+
+  regs.set_ip(tid, addr);
+  if (syscall(SYS_tgkill, pid, tid, 0) == -1) {
+    // A thread of a forked process, which has its own copy of the code
+    restore_byte(tid, addr, it->second.saved);
+  }
+  hit(addr, it->second);
+  return true;
+}
+
+/**
+* print the share of executed lines of each source file, like gcov does
+* @param out the stream to print to
+*/
+void line_coverage::print_summary(FILE* out) const {
+  line_map files;
+  collect(files);
+  for (auto &file : files) {
+    unsigned executed = 0;
+    for (auto &line : file.second) {
+      executed += line.second;
+    }
+    fprintf(out, "File '%s'\n", file.first.c_str());
+    fprintf(out, "Lines executed:%.2f%% of %zu\n\n", 100.0 * executed / file.second.size(),
+            file.second.size());
+  }
+}
+
+/**
+* print each source file, with each line marked as executed, not
+*   executed or without code, in gcov's annotated source format
+* @param out the stream to print to
+*/
+void line_coverage::print_report(FILE* out) const {
+  line_map files;
+  collect(files);
+  char* text = NULL;
+  size_t size = 0;
+  for (auto &file : files) {
+    fprintf(out, "%9s:%5u:Source:%s\n", "-", 0, file.first.c_str());
+
+    // Lines are only counted once, since their breakpoints are removed
+    auto line = file.second.begin();
+    FILE* source = fopen(file.first.c_str(), "r");
+    unsigned number = 1;
+    ssize_t len;
+    while (source != NULL && (len = getline(&text, &size, source)) >= 0) {
+      if (len > 0 && text[len - 1] == '\n') {
+        text[len - 1] = '\0';
+      }
+      const char* count = "-";
+      if (line != file.second.end() && line->first == number) {
+        count = line->second ? "1" : "#####";
+        ++line;
+      }
+      fprintf(out, "%9s:%5u:%s\n", count, number, text);
+      number++;
+    }
+    if (source != NULL) {
+      fclose(source);
+    }
+
+    // Lines past the end of the source file, or all of them if the file
+    //   cannot be read
+    for (; line != file.second.end(); ++line) {
+      fprintf(out, "%9s:%5u:\n", line->second ? "1" : "#####", line->first);
+    }
+  }
+  free(text);
+}
+
+/**
+* record a breakpoint as reached, and remove it
+* @param addr the breakpoint address
+* @param s    the breakpoint
+*/
+void line_coverage::hit(intptr_t addr, site &s) {
+  if (s.hit) {
+    return;
+  }
+  s.hit = true;
+  lines[s.line].hit = true;
+  breakpoints.remove(addr);
+  breakpoints.flush();
+}
+
+/**
+* merge the source lines of all objects by file name, since the same file
+*   may be compiled into several objects
+* @param files set to the executed state of each line with code
+*/
+void line_coverage::collect(line_map &files) const {
+  for (auto &line : lines) {
+    bool &hit = files[line.file][line.line];
+    hit = hit || line.hit;
+  }
+}
@@ -0,0 +1,120 @@
+#ifndef _LINE_COVERAGE_HH_
+#define _LINE_COVERAGE_HH_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "breakpoint_manager.hh"
+#include "register_cache.hh"
+#include "shared_object.hh"
+
+/**
+ * Records which source lines a program executes, with a one-shot breakpoint
+ *   at the first address of each statement row of the line tables of the
+ *   objects with debug information. A breakpoint is removed the first time
+ *   a thread reaches it, so each line costs a stop or two and the program
+ *   otherwise runs at full speed. Forked processes get a copy of the
+ *   breakpoints but not their removal, so their hits restore the original
+ *   code in their own copy.
+ */
+class line_coverage {
+public:
+
+  /**
+  * construct a new line coverage recorder
+  * @param pid         the traced process
+  * @param regs        the registers of the traced threads
+  * @param breakpoints the breakpoints of the traced process
+  */
+  line_coverage(pid_t pid, register_cache &regs, breakpoint_manager &breakpoints)
+  : pid(pid), regs(regs), breakpoints(breakpoints)
+  {}
+
+  /**
+  * insert a breakpoint at each statement row of the objects with debug
+  *   information
+  * @param  objects the mapped objects of the traced process, stopped
+  * @return         the number of source lines with a breakpoint
+  */
+  size_t attach(std::vector<shared_obj> &objects);
+
+  /**
+  * record the lines of a range of code as executed, e.g. the code run
+  *   before the breakpoints were inserted, removing their breakpoints
+  * @param low  the first address of the range
+  * @param high the end address (exclusive) of the range
+  */
+  void mark_executed(intptr_t low, intptr_t high);
+
+  /**
+  * check whether a SIGTRAP stop of a thread is at one of the breakpoints,
+  *   and if so record its line and move the thread back onto the original
+  *   instruction
+  * @param  tid the stopped thread
+  * @return     true if the thread executed one of the breakpoints, false
+  *             otherwise
+  */
+  bool handle_stop(pid_t tid);
+
+  /**
+  * print the share of executed lines of each source file, like gcov does
+  * @param out the stream to print to
+  */
+  void print_summary(FILE* out) const;
+
+  /**
+  * print each source file, with each line marked as executed, not
+  *   executed or without code, in gcov's annotated source format
+  * @param out the stream to print to
+  */
+  void print_report(FILE* out) const;
+
+private:
+  // A breakpoint address
+  struct site {
+    uint32_t line; // Index of the source line in lines
+    uint8_t saved; // Original byte at the address
+    bool hit;      // Whether a thread reached the address
+  };
+
+  // A source line with at least one breakpoint
+  struct source_line {
+    const char* file; // Absolute path of the source file
+    unsigned line;    // Line number
+    bool hit;         // Whether one of its breakpoints was reached
+  };
+
+  // The executed state of each line with code, by file and line number
+  typedef std::map<std::string, std::map<unsigned, bool>> line_map;
+
+  /**
+  * record a breakpoint as reached, and remove it
+  * @param addr the breakpoint address
+  * @param s    the breakpoint
+  */
+  void hit(intptr_t addr, site &s);
+
+  /**
+  * merge the source lines of all objects by file name, since the same file
+  *   may be compiled into several objects
+  * @param files set to the executed state of each line with code
+  */
+  void collect(line_map &files) const;
+
+  pid_t pid;                                // The traced process
+  register_cache &regs;                     // Registers of the traced threads
+  breakpoint_manager &breakpoints;          // Breakpoints of the traced process
+  std::unordered_map<intptr_t, site> sites; // Breakpoints, kept after they are hit
+  std::vector<source_line> lines;           // Source lines with a breakpoint
+  std::map<std::pair<const char*, unsigned>, uint32_t> line_ids; // Index of each line
+};
+
+#endif /* _LINE_COVERAGE_HH_ */
@@ -0,0 +1,458 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "line_index.hh"
+
+// Layout of an index file: this header, followed by row_count line_rows,
+//   function_count function_rows, name_count uint32_t name offsets and
+//   names_size bytes of file and function names
+struct line_index_header {
+  char magic[8];           // INDEX_MAGIC
+  uint32_t version;        // INDEX_VERSION
+  uint32_t has_cus;        // Whether the indexed ELF file has compilation units
+  uint64_t row_count;      // Number of rows
+  uint64_t function_count; // Number of function rows
+  uint64_t name_count;     // Number of names
+  uint64_t names_size;     // Size of the name data, in bytes
+};
+
+static const char INDEX_MAGIC[8] = "PDBGIDX";
+static const uint32_t INDEX_VERSION = 3;
+
+// Abstract origins and specifications followed to find a function's name,
+//   at most
+#define MAX_NAME_REFERENCES 4
+
+/**
+* get the name of a function DIE, which inlined calls, out-of-line copies of
+*   inline functions and definitions of C++ member functions take from the
+*   DIE they refer to
+* @param  die  a subprogram or inlined subroutine DIE
+* @param  name set to the function's name
+* @return      true if the function has a name, false otherwise
+*/
+static bool function_name(dwarf::die die, std::string &name) {
+  for (int i = 0; i <= MAX_NAME_REFERENCES; i++) {
+    if (die.has(dwarf::DW_AT::name)) {
+      name = at_name(die);
+      return true;
+    }
+    if (die.has(dwarf::DW_AT::abstract_origin)) {
+      die = die[dwarf::DW_AT::abstract_origin].as_reference();
+    } else if (die.has(dwarf::DW_AT::specification)) {
+      die = die[dwarf::DW_AT::specification].as_reference();
+    } else {
+      return false;
+    }
+  }
+  return false;
+}
+
+line_index::line_index()
+: row_data{nullptr}, row_count{0}, function_data{nullptr}, function_count{0},
+  offset_data{nullptr}, name_data{nullptr}, name_count{0}, mapping{nullptr},
+  mapping_size{0}
+{}
+
+line_index::~line_index() {
+  if (mapping != nullptr) {
+    munmap(mapping, mapping_size);
+  }
+}
+
+/**
+* append the rows of a compilation unit's line table to this index
+* @param lt a dwarf line table
+*/
+void line_index::add_line_table(const dwarf::line_table &lt) {
+  for (auto &entry : lt) {
+    line_row row;
+    row.address = entry.address;
+    if (entry.end_sequence) {
+      row.file = END_SEQUENCE;
+      row.line = 0;
+      row.is_stmt = false;
+    } else {
+      row.file = intern(entry.file->path);
+      row.line = entry.line;
+      row.is_stmt = entry.is_stmt;
+    }
+    rows.push_back(row);
+  }
+}
+
+/**
+* append the address ranges of a compilation unit's functions, and of the
+*   calls inlined into them, to this index
+* @param cu a dwarf compilation unit
+*/
+void line_index::add_functions(const dwarf::compilation_unit &cu) {
+  size_t count = ranges.size();
+  try {
+    add_function_ranges(cu.root(), 0, NO_FUNCTION);
+  } catch(std::exception &e) {
+    // Malformed references or range attributes: drop the whole unit, rather
+    //   than keep inlined calls without the function they are in
+    ranges.resize(count);
+  }
+}
+
+/**
+* append the ranges of the functions and inlined calls below a DIE
+* @param parent the DIE whose children are searched
+* @param depth  the nesting depth of the children
+* @param outer  the function the children are in, or NO_FUNCTION
+*/
+void line_index::add_function_ranges(const dwarf::die &parent, unsigned depth, uint32_t outer) {
+  for (const auto &die : parent) {
+    if (die.tag == dwarf::DW_TAG::lexical_block || die.tag == dwarf::DW_TAG::namespace_) {
+      // Blocks and namespaces only group the functions and calls they hold
+      add_function_ranges(die, depth, outer);
+      continue;
+    }
+    if (die.tag != dwarf::DW_TAG::subprogram && die.tag != dwarf::DW_TAG::inlined_subroutine) {
+      continue;
+    }
+    // Declarations and abstract instances of inline functions have no code
+    std::string name;
+    if ((!die.has(dwarf::DW_AT::low_pc) && !die.has(dwarf::DW_AT::ranges))
+        || !function_name(die, name)) {
+      continue;
+    }
+    uint32_t id = intern(name);
+    uint32_t function = outer == NO_FUNCTION ? id : outer;
+    for (auto &range : die_pc_range(die)) {
+      if (range.low < range.high) {
+        ranges.push_back(function_range{range.low, range.high, depth, id, function});
+      }
+    }
+    add_function_ranges(die, depth + 1, function);
+  }
+}
+
+/**
+* add a name to the name table, unless it is already there
+* @param  name a file or function name
+* @return      the name's index
+*/
+uint32_t line_index::intern(const std::string &name) {
+  auto it = name_ids.find(name);
+  if (it == name_ids.end()) {
+    it = name_ids.emplace(name, name_offsets.size()).first;
+    name_offsets.push_back(names.size());
+    names.append(name.c_str(), name.size() + 1);
+  }
+  return it->second;
+}
+
+/**
+* flatten the appended function ranges into sorted, disjoint rows
+*/
+void line_index::flatten_functions() {
+  // Enclosing ranges sort before the ranges nested in them
+  std::sort(ranges.begin(), ranges.end(), [](const function_range &a, const function_range &b) {
+    if (a.low != b.low) {
+      return a.low < b.low;
+    }
+    if (a.depth != b.depth) {
+      return a.depth < b.depth;
+    }
+    return a.high > b.high;
+  });
+
+  // Start a row, replacing a row starting at the same address, and merging
+  //   it with the previous row if their functions are the same
+  auto emit = [this](uint64_t address, uint32_t name, uint32_t outer) {
+    if (!functions.empty() && functions.back().address == address) {
+      functions.pop_back();
+    }
+    if (functions.empty() ? name != NO_FUNCTION
+        : functions.back().name != name || functions.back().outer != outer) {
+      functions.push_back(function_row{address, name, outer});
+    }
+  };
+
+  // Sweep the ranges, keeping the ones containing the current address on a
+  //   stack, innermost last
+  std::vector<function_range> open;
+  auto close_before = [&](uint64_t address) {
+    while (!open.empty() && open.back().high <= address) {
+      uint64_t end = open.back().high;
+      open.pop_back();
+      if (open.empty()) {
+        emit(end, NO_FUNCTION, NO_FUNCTION);
+      } else {
+        emit(end, open.back().name, open.back().outer);
+      }
+    }
+  };
+  for (auto range : ranges) {
+    close_before(range.low);
+    // Ranges only partly nested in the enclosing one are cut at its end
+    if (!open.empty() && range.high > open.back().high) {
+      range.high = open.back().high;
+    }
+    if (range.low >= range.high) {
+      continue;
+    }
+    emit(range.low, range.name, range.outer);
+    open.push_back(range);
+  }
+  close_before(UINT64_MAX);
+
+  ranges.clear();
+  ranges.shrink_to_fit();
+  functions.shrink_to_fit();
+}
+
+/**
+* sort the rows and function ranges appended so far. Must be called
+*   before find() and find_function().
+*/
+void line_index::finish() {
+  // A sequence may start at the address where another one ends, so end
+  //   markers sort first. Otherwise keep the line table order, so that the
+  //   last row at an address wins as it does in line_table::find_address.
+  std::stable_sort(rows.begin(), rows.end(), [](const line_row &a, const line_row &b) {
+    if (a.address != b.address) {
+      return a.address < b.address;
+    }
+    return a.file == END_SEQUENCE && b.file != END_SEQUENCE;
+  });
+  rows.shrink_to_fit();
+  flatten_functions();
+  name_ids.clear();
+
+  row_data = rows.data();
+  row_count = rows.size();
+  function_data = functions.data();
+  function_count = functions.size();
+  offset_data = name_offsets.data();
+  name_data = names.data();
+  name_count = name_offsets.size();
+}
+
+/**
+* find the line table row covering an address
+* @param  addr an address relative to the start of the file
+* @param  info the row's file, line and address range
+* @return      true if a row was found, false otherwise
+*/
+bool line_index::find(uint64_t addr, line_info &info) const {
+  // Find the last row starting at or before addr
+  auto it = std::upper_bound(row_data, row_data + row_count, addr,
+    [](uint64_t a, const line_row &row) { return a < row.address; });
+  if (it == row_data) {
+    return false;
+  }
+  --it;
+
+  // Addresses past the end of a sequence have no line
+  if (it->file == END_SEQUENCE) {
+    return false;
+  }
+
+  info.file = name_data + offset_data[it->file];
+  info.line = it->line;
+  info.is_stmt = it->is_stmt;
+  info.address = it->address;
+  info.end = it + 1 < row_data + row_count ? (it + 1)->address : UINT64_MAX;
+  return true;
+}
+
+/**
+* get the rows starting within an address range
+* @param low  the first address of the range, relative to the start of the file
+* @param high the end address (exclusive) of the range
+* @param out  a vector to append the rows' file, line and address range to
+*/
+void line_index::get_rows(uint64_t low, uint64_t high, std::vector<line_info> &out) const {
+  auto it = std::lower_bound(row_data, row_data + row_count, low,
+    [](const line_row &row, uint64_t a) { return row.address < a; });
+  for (; it != row_data + row_count && it->address < high; ++it) {
+    if (it->file != END_SEQUENCE) {
+      line_info info;
+      info.file = name_data + offset_data[it->file];
+      info.line = it->line;
+      info.is_stmt = it->is_stmt;
+      info.address = it->address;
+      info.end = it + 1 < row_data + row_count ? (it + 1)->address : UINT64_MAX;
+      out.push_back(info);
+    }
+  }
+}
+
+/**
+* find the innermost function containing an address
+* @param  addr an address relative to the start of the file
+* @param  info the function's name, and the range of addresses it is the
+*              innermost function of
+* @return      true if a function was found, false otherwise
+*/
+bool line_index::find_function(uint64_t addr, function_info &info) const {
+  // Find the last row starting at or before addr
+  auto it = std::upper_bound(function_data, function_data + function_count, addr,
+    [](uint64_t a, const function_row &row) { return a < row.address; });
+  if (it == function_data || (it - 1)->name == NO_FUNCTION) {
+    return false;
+  }
+  --it;
+
+  info.name = name_data + offset_data[it->name];
+  info.outer = it->outer == it->name ? nullptr : name_data + offset_data[it->outer];
+  info.address = it->address;
+  info.end = it + 1 < function_data + function_count ? (it + 1)->address : UINT64_MAX;
+  return true;
+}
+
+/**
+* write this index to a file that load() can memory map
+* @param  file_path the path of the index file
+* @param  has_cus   whether the indexed ELF file has compilation units
+* @return           true if the file was written, false otherwise
+*/
+bool line_index::save(const std::string &file_path, bool has_cus) const {
+  line_index_header hdr;
+  memcpy(hdr.magic, INDEX_MAGIC, sizeof(hdr.magic));
+  hdr.version = INDEX_VERSION;
+  hdr.has_cus = has_cus;
+  hdr.row_count = row_count;
+  hdr.function_count = function_count;
+  hdr.name_count = name_count;
+  hdr.names_size = name_count == 0 ? 0 : names.size();
+
+  // Write to a temporary file and rename it, so that concurrent debugging
+  //   sessions never see a partially written index
+  std::string tmp_path = file_path + "." + std::to_string(getpid()) + ".tmp";
+  FILE* out = fopen(tmp_path.c_str(), "w");
+  if (out == NULL) {
+    return false;
+  }
+  bool ok = fwrite(&hdr, sizeof(hdr), 1, out) == 1
+    && fwrite(row_data, sizeof(line_row), row_count, out) == row_count
+    && fwrite(function_data, sizeof(function_row), function_count, out) == function_count
+    && fwrite(offset_data, sizeof(uint32_t), name_count, out) == name_count
+    && fwrite(name_data, 1, hdr.names_size, out) == hdr.names_size;
+  ok = (fclose(out) == 0) && ok;
+
+  if (!ok || rename(tmp_path.c_str(), file_path.c_str()) == -1) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+/**
+* check that a table of an index file fits in the bytes left in the file
+* @param  count     the number of items in the table
+* @param  item_size the size of an item
+* @param  left      the number of bytes left, reduced by the table's size
+* @return           true if the table fits, false otherwise
+*/
+static bool take_table(uint64_t count, size_t item_size, size_t &left) {
+  if (count > left / item_size) {
+    return false;
+  }
+  left -= count * item_size;
+  return true;
+}
+
+/**
+* replace this index with one memory mapped from a file written by save()
+* @param  file_path the path of the index file
+* @param  has_cus   set to whether the indexed ELF file has compilation units
+* @return           true if the file was loaded, false if it is missing or
+*                   not a valid index file
+*/
+bool line_index::load(const std::string &file_path, bool &has_cus) {
+  int fd = open(file_path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(line_index_header)) {
+    close(fd);
+    return false;
+  }
+
+  size_t size = st.st_size;
+  void* base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+
+  // Check that the header matches this version, and the file its sizes.
+  //   Each table is checked against the bytes left, so that corrupt counts
+  //   cannot overflow the sum.
+  auto hdr = static_cast<const line_index_header*>(base);
+  size_t left = size - sizeof(line_index_header);
+  bool ok = memcmp(hdr->magic, INDEX_MAGIC, sizeof(hdr->magic)) == 0
+    && hdr->version == INDEX_VERSION
+    && take_table(hdr->row_count, sizeof(line_row), left)
+    && take_table(hdr->function_count, sizeof(function_row), left)
+    && take_table(hdr->name_count, sizeof(uint32_t), left)
+    && hdr->names_size == left;
+  if (!ok) {
+    munmap(base, size);
+    return false;
+  }
+
+  auto data = static_cast<const char*>(base) + sizeof(line_index_header);
+  auto file_rows = reinterpret_cast<const line_row*>(data);
+  data += hdr->row_count * sizeof(line_row);
+  auto file_functions = reinterpret_cast<const function_row*>(data);
+  data += hdr->function_count * sizeof(function_row);
+  auto file_offsets = reinterpret_cast<const uint32_t*>(data);
+  data += hdr->name_count * sizeof(uint32_t);
+  const char* file_names = data;
+
+  // Check every index once here, so that lookups need no checks. Names
+  //   must start inside the name data, which must end with a NUL.
+  ok = hdr->name_count == 0 || (hdr->names_size > 0 && file_names[hdr->names_size - 1] == '\0');
+  for (size_t i = 0; ok && i < hdr->name_count; i++) {
+    ok = file_offsets[i] < hdr->names_size;
+  }
+  for (size_t i = 0; ok && i < hdr->row_count; i++) {
+    ok = file_rows[i].file == END_SEQUENCE || file_rows[i].file < hdr->name_count;
+  }
+  for (size_t i = 0; ok && i < hdr->function_count; i++) {
+    ok = file_functions[i].name == NO_FUNCTION
+      || (file_functions[i].name < hdr->name_count && file_functions[i].outer < hdr->name_count);
+  }
+  if (!ok) {
+    munmap(base, size);
+    return false;
+  }
+
+  // Point the lookup arrays into the mapping
+  row_data = file_rows;
+  row_count = hdr->row_count;
+  function_data = file_functions;
+  function_count = hdr->function_count;
+  offset_data = file_offsets;
+  name_count = hdr->name_count;
+  name_data = file_names;
+  has_cus = hdr->has_cus;
+
+  // Release the built tables, if any
+  if (mapping != nullptr) {
+    munmap(mapping, mapping_size);
+  }
+  rows.clear();
+  functions.clear();
+  names.clear();
+  name_offsets.clear();
+  mapping = base;
+  mapping_size = size;
+  return true;
+}
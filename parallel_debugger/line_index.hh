@@ -0,0 +1,196 @@
+#ifndef _LINE_INDEX_HH_
+#define _LINE_INDEX_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "dwarf++.hh"
+
+/**
+ * A single row of a flattened line table
+ */
+struct line_row {
+  uint64_t address; // File-relative address of the first instruction of the row
+  uint32_t file;    // Index into the file name table, or END_SEQUENCE
+  uint32_t line : 31;   // Source line number
+  uint32_t is_stmt : 1; // Whether the row starts a statement, where a
+                        //   breakpoint for the line belongs
+};
+
+/**
+ * A range of addresses whose innermost function is the same. The range
+ *   ends where the next row starts.
+ */
+struct function_row {
+  uint64_t address; // File-relative address of the first instruction of the range
+  uint32_t name;    // Index into the name table, or NO_FUNCTION
+  uint32_t outer;   // Name of the function the code was inlined into, or
+                    //   name if it was not inlined
+};
+
+/**
+ * The result of a line lookup
+ */
+struct line_info {
+  const char* file; // Absolute path of the source file
+  unsigned line;    // Source line number
+  uint64_t address; // File-relative address of the start of the matching row
+  uint64_t end;     // File-relative address where the row ends
+  bool is_stmt;     // Whether the row starts a statement
+};
+
+/**
+ * The result of a function lookup
+ */
+struct function_info {
+  const char* name;  // Innermost function containing the address
+  const char* outer; // Function it was inlined into, or nullptr if not inlined
+  uint64_t address;  // File-relative address where this function's range starts
+  uint64_t end;      // File-relative address where the range ends
+};
+
+/**
+ * The line tables and function ranges of a file, flattened into arrays
+ *   sorted by address so that lookups are binary searches. Source file and
+ *   function names are interned in a single name table. Nested function
+ *   ranges, such as inlined calls, are flattened into disjoint ranges of
+ *   their innermost function.
+ */
+class line_index {
+public:
+  // Marks a row that ends a sequence of addresses
+  static const uint32_t END_SEQUENCE = UINT32_MAX;
+
+  // Marks a function row of addresses outside of every function
+  static const uint32_t NO_FUNCTION = UINT32_MAX;
+
+  line_index();
+  ~line_index();
+
+  // The index may point into a memory mapped file, so it cannot be copied
+  line_index(const line_index&) = delete;
+  line_index& operator=(const line_index&) = delete;
+
+  /**
+  * append the rows of a compilation unit's line table to this index
+  * @param lt a dwarf line table
+  */
+  void add_line_table(const dwarf::line_table &lt);
+
+  /**
+  * append the address ranges of a compilation unit's functions, and of the
+  *   calls inlined into them, to this index
+  * @param cu a dwarf compilation unit
+  */
+  void add_functions(const dwarf::compilation_unit &cu);
+
+  /**
+  * sort the rows and function ranges appended so far. Must be called
+  *   before find() and find_function().
+  */
+  void finish();
+
+  /**
+  * find the line table row covering an address
+  * @param  addr an address relative to the start of the file
+  * @param  info the row's file, line and address range
+  * @return      true if a row was found, false otherwise
+  */
+  bool find(uint64_t addr, line_info &info) const;
+
+  /**
+  * get the rows starting within an address range
+  * @param low  the first address of the range, relative to the start of the file
+  * @param high the end address (exclusive) of the range
+  * @param out  a vector to append the rows' file, line and address range to
+  */
+  void get_rows(uint64_t low, uint64_t high, std::vector<line_info> &out) const;
+
+  /**
+  * find the innermost function containing an address
+  * @param  addr an address relative to the start of the file
+  * @param  info the function's name, and the range of addresses it is the
+  *              innermost function of
+  * @return      true if a function was found, false otherwise
+  */
+  bool find_function(uint64_t addr, function_info &info) const;
+
+  /**
+  * write this index to a file that load() can memory map
+  * @param  file_path the path of the index file
+  * @param  has_cus   whether the indexed ELF file has compilation units
+  * @return           true if the file was written, false otherwise
+  */
+  bool save(const std::string &file_path, bool has_cus) const;
+
+  /**
+  * replace this index with one memory mapped from a file written by save()
+  * @param  file_path the path of the index file
+  * @param  has_cus   set to whether the indexed ELF file has compilation units
+  * @return           true if the file was loaded, false if it is missing or
+  *                   not a valid index file
+  */
+  bool load(const std::string &file_path, bool &has_cus);
+
+  /**
+  * @return the number of rows in this index
+  */
+  auto size() const -> size_t { return row_count; }
+
+private:
+  // An address range of a function or of an inlined call, before the
+  //   ranges are flattened
+  struct function_range {
+    uint64_t low;    // First file-relative address
+    uint64_t high;   // End address (exclusive)
+    unsigned depth;  // Nesting depth, 0 for a function
+    uint32_t name;   // Index into the name table
+    uint32_t outer;  // Name of the function the range is in
+  };
+
+  /**
+  * add a name to the name table, unless it is already there
+  * @param  name a file or function name
+  * @return      the name's index
+  */
+  uint32_t intern(const std::string &name);
+
+  /**
+  * append the ranges of the functions and inlined calls below a DIE
+  * @param parent the DIE whose children are searched
+  * @param depth  the nesting depth of the children
+  * @param outer  the function the children are in, or NO_FUNCTION
+  */
+  void add_function_ranges(const dwarf::die &parent, unsigned depth, uint32_t outer);
+
+  /**
+  * flatten the appended function ranges into sorted, disjoint rows
+  */
+  void flatten_functions();
+
+  std::vector<line_row> rows;           // Rows of all line tables, sorted by address
+  std::vector<function_range> ranges;   // Function ranges, until finish()
+  std::vector<function_row> functions;  // Flattened function ranges, sorted by address
+  std::string names;                    // File and function names, NUL separated
+  std::vector<uint32_t> name_offsets;   // Offset of each name in names
+  std::unordered_map<std::string, uint32_t> name_ids; // Name to name index
+
+  // The arrays used by find(), either owned by the vectors above or
+  //   pointing into a memory mapped index file
+  const line_row* row_data;
+  size_t row_count;
+  const function_row* function_data;
+  size_t function_count;
+  const uint32_t* offset_data;
+  const char* name_data;
+  size_t name_count;
+
+  void* mapping;       // Memory mapped index file, if any
+  size_t mapping_size; // Size of the memory mapped index file
+};
+
+#endif /* _LINE_INDEX_HH_ */
@@ -0,0 +1,298 @@
+#include <signal.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+
+#include <algorithm>
+
+#include "line_stepper.hh"
+#include "process_memory.hh"
+
+// Number of stack words searched for the return address
+#define STACK_SCAN_WORDS 256
+
+// Kinds of call instructions that can precede a return address
+enum call_kind { NOT_A_CALL, DIRECT_CALL, INDIRECT_CALL };
+
+/**
+* check whether a possible return address follows a call instruction
+* @param  tid    a stopped thread of the traced process
+* @param  ret    the possible return address
+* @param  target set to the target of a direct call
+* @return        the kind of call preceding ret, if any
+*/
+static call_kind preceding_call(pid_t tid, intptr_t ret, intptr_t &target) {
+  uint8_t code[6];
+  if (!read_memory(tid, ret - sizeof(code), code, sizeof(code))) {
+    return NOT_A_CALL;
+  }
+  if (code[1] == 0xe8) {
+    // call rel32
+    int32_t rel;
+    memcpy(&rel, code + 2, sizeof(rel));
+    target = ret + rel;
+    return DIRECT_CALL;
+  }
+  if ((code[0] == 0xff && (code[1] == 0x15 || (code[1] & 0xf8) == 0x90))
+      || (code[3] == 0xff && (code[4] & 0xf8) == 0x50)
+      || (code[4] == 0xff && (code[5] & 0xf8) == 0xd0)) {
+    // call through memory or a register
+    return INDIRECT_CALL;
+  }
+  return NOT_A_CALL;
+}
+
+/**
+* handle a stop of a thread that was resumed by resume()
+* @param  tid the stopped thread. Its instruction pointer is moved back
+*             onto the breakpoint if one was hit.
+* @return     true if the thread reached its next instruction or source
+*             line and should be reported, false if the stop was
+*             internal and the thread was already resumed
+*/
+bool line_stepper::handle_stop(pid_t tid) {
+  auto it = plans.find(tid);
+  if (it == plans.end()) {
+    // First stop of a new thread
+    return true;
+  }
+  step_plan &plan = it->second;
+
+  // Check whether the thread executed one of the breakpoints, possibly
+  //   one released by another thread since
+  intptr_t addr = regs.get_ip(tid) - 1;
+  if (breakpoints.is_breakpoint_stop(tid, addr)) {
+    // Move back onto the breakpoint address
+    regs.set_ip(tid, addr);
+
+    auto &owned = plan.breakpoints;
+    if (std::find(owned.begin(), owned.end(), addr) != owned.end()) {
+      // The thread reached its next line
+      clear_plan(tid);
+      return true;
+    }
+
+    // Another thread's breakpoint: execute the original instruction
+    regs.invalidate(tid);
+    if (!step_over(tid, addr)) {
+      thread_exited(tid);
+      return false;
+    }
+    if (!plan.single_step) {
+      run(tid, false, 0);
+      return false;
+    }
+  }
+
+  // When single-stepping a line, only report the thread once it leaves it
+  if (plan.single_step && plan.line != 0) {
+    intptr_t ip = regs.get_ip(tid);
+    shared_obj *obj = index.find(ip, hints[tid]);
+    if (obj != nullptr && obj->has_cus()) {
+      try {
+        auto entry = obj->get_line_entry_from_ip(ip);
+        // File names are interned, so equal names have equal pointers
+        if (entry.line == plan.line && entry.file == plan.file) {
+          run(tid, true, 0);
+          return false;
+        }
+      } catch(std::out_of_range &e) {
+        // Left the line for code without line information
+      }
+    }
+  }
+
+  clear_plan(tid);
+  return true;
+}
+
+/**
+* plan the next stop of a thread and resume it
+* @param tid the stopped thread
+*/
+void line_stepper::resume(pid_t tid) {
+  step_plan &plan = plans[tid];
+  plan.breakpoints.clear();
+  plan.single_step = true;
+  plan.file = nullptr;
+  plan.line = 0;
+
+  intptr_t ip = regs.get_ip(tid);
+  shared_obj *obj = index.find(ip, hints[tid]);
+  bool has_debug_info = obj != nullptr && obj->has_cus();
+
+  if (skip_nodebug && !has_debug_info) {
+    // Just entered code without debug information: run until it returns to
+    //   the caller, whose return address is on top of the stack
+    uint64_t ret;
+    intptr_t target;
+    if (read_memory(tid, regs.get_sp(tid), &ret, sizeof(ret))
+        && preceding_call(tid, ret, target) != NOT_A_CALL) {
+      size_t caller_hint = 0;
+      shared_obj *caller = index.find(ret, caller_hint);
+      if (caller != nullptr && caller->has_cus()) {
+        plan.breakpoints.push_back(ret);
+        breakpoints.insert(ret);
+        plan.single_step = false;
+      }
+    }
+  } else if (by_line && has_debug_info) {
+    try {
+      auto current = obj->get_line_entry_from_ip(ip);
+      plan.file = current.file;
+      plan.line = current.line;
+
+      // Break at every other line of the function, and where it returns
+      std::vector<line_info> rows;
+      std::vector<intptr_t> starts;
+      if (obj->get_function_rows(ip, rows, starts)) {
+        intptr_t ret = find_return_address(tid, obj, starts);
+        if (ret != 0) {
+          for (auto &row : rows) {
+            if (row.line != current.line || row.file != current.file) {
+              plan.breakpoints.push_back(row.address);
+            }
+          }
+          plan.breakpoints.push_back(ret);
+
+          std::sort(plan.breakpoints.begin(), plan.breakpoints.end());
+          plan.breakpoints.erase(std::unique(plan.breakpoints.begin(), plan.breakpoints.end()),
+                                 plan.breakpoints.end());
+          for (auto addr : plan.breakpoints) {
+            breakpoints.insert(addr);
+          }
+          plan.single_step = false;
+        }
+      }
+    } catch(std::out_of_range &e) {
+      // No line information: single-step
+    }
+  }
+
+  run(tid, plan.single_step, 0);
+}
+
+/**
+* resume a thread after a stop that is not part of its plan, such as a
+*   signal or a ptrace event, without changing the plan
+* @param tid the stopped thread
+* @param sig the signal to deliver, or 0
+*/
+void line_stepper::keep_going(pid_t tid, int sig) {
+  // Threads without a plan have not been reported yet
+  auto it = plans.find(tid);
+  run(tid, it == plans.end() || it->second.single_step, sig);
+}
+
+/**
+* forget a thread that exited, releasing its breakpoints
+* @param tid the exited thread
+*/
+void line_stepper::thread_exited(pid_t tid) {
+  if (plans.count(tid)) {
+    clear_plan(tid);
+    plans.erase(tid);
+  }
+  hints.erase(tid);
+}
+
+/**
+* resume a stopped thread, applying the pending breakpoint changes and
+*   forgetting its cached registers
+* @param tid         the stopped thread
+* @param single_step whether to stop after one instruction
+* @param sig         the signal to deliver, or 0
+*/
+void line_stepper::run(pid_t tid, bool single_step, int sig) {
+  breakpoints.flush();
+  regs.invalidate(tid);
+  ptrace(single_step ? PTRACE_SINGLESTEP : PTRACE_CONT, tid, NULL, sig);
+}
+
+/**
+* execute the original instruction under a breakpoint, stopping the other
+*   running threads meanwhile so that none of them runs past it unseen
+* @param  tid  a thread stopped at the breakpoint address
+* @param  addr the breakpoint address
+* @return      true if the thread is still stopped, false if it exited
+*/
+bool line_stepper::step_over(pid_t tid, intptr_t addr) {
+  std::vector<pid_t> paused;
+  threads.pause_others(pid, tid, paused);
+  bool stopped = breakpoints.step_over(tid, addr);
+
+  // Each paused thread goes on as planned, single-stepped or continued
+  for (pid_t other : paused) {
+    threads.find(other)->state = thread_state::RUNNING;
+    keep_going(other, 0);
+  }
+  return stopped;
+}
+
+/**
+* release all the breakpoints of a thread's plan
+* @param tid the thread whose plan is cleared
+*/
+void line_stepper::clear_plan(pid_t tid) {
+  auto &plan = plans[tid];
+  for (auto addr : plan.breakpoints) {
+    breakpoints.remove(addr);
+  }
+  plan.breakpoints.clear();
+}
+
+/**
+* find the return address of a thread's current function from its call
+*   frame information, or else by scanning its stack for a word that
+*   follows a call to that function
+* @param  tid    the stopped thread
+* @param  obj    the shared object containing the function
+* @param  starts the system memory addresses of the function's ranges
+* @return        the return address, or 0 if none was found
+*/
+intptr_t line_stepper::find_return_address(pid_t tid, shared_obj *obj,
+                                           const std::vector<intptr_t> &starts) {
+  intptr_t ret = unwinder.return_address(tid, regs);
+  if (ret != 0) {
+    return ret;
+  }
+
+  // Read the top of the stack at once. The stack may end before the whole
+  //   window, so retry with smaller windows.
+  uint64_t stack[STACK_SCAN_WORDS];
+  size_t words = STACK_SCAN_WORDS;
+  intptr_t sp = regs.get_sp(tid);
+  while (words > 0 && !read_memory(tid, sp, stack, words * sizeof(uint64_t))) {
+    words /= 2;
+  }
+
+  size_t hint = 0;
+  for (size_t i = 0; i < words; i++) {
+    ret = stack[i];
+    if (index.find(ret, hint) == nullptr) {
+      continue;
+    }
+
+    // Return addresses follow a call instruction
+    intptr_t target;
+    auto kind = preceding_call(tid, ret, target);
+    if (kind == DIRECT_CALL) {
+      // Accept a direct call if it calls this function, or a stub in
+      //   another object (a PLT entry). Otherwise it is a stale word left
+      //   behind by an earlier call.
+      if (std::find(starts.begin(), starts.end(), target) != starts.end()) {
+        return ret;
+      }
+      size_t target_hint = 0;
+      shared_obj *callee = index.find(target, target_hint);
+      if (callee != nullptr && callee->get_info() != obj->get_info()) {
+        return ret;
+      }
+    } else if (kind == INDIRECT_CALL) {
+      return ret;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,133 @@
+#ifndef _LINE_STEPPER_HH_
+#define _LINE_STEPPER_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "breakpoint_manager.hh"
+#include "object_index.hh"
+#include "register_cache.hh"
+#include "stack_unwinder.hh"
+#include "thread_table.hh"
+
+/**
+ * Advances traced threads. By default every instruction is single-stepped.
+ *   In line mode, a thread is instead continued with temporary breakpoints
+ *   at the start of every other line of its current function and at its
+ *   return address; single-stepping is only used when those cannot be found.
+ *   When skipping code without debug information, a thread entering such
+ *   code is continued until it returns to its caller. The other threads are
+ *   stopped while a thread steps over a breakpoint it does not own.
+ */
+class line_stepper {
+public:
+
+  /**
+  * construct a new line stepper
+  * @param pid          the traced process
+  * @param threads      the traced threads
+  * @param index        the address index of the traced process' shared objects
+  * @param regs         the registers of the traced threads
+  * @param breakpoints  the breakpoints of the traced process
+  * @param by_line      whether threads are advanced by source line rather
+  *                     than by instruction
+  * @param skip_nodebug whether calls into code without debug information
+  *                     are run at full speed until they return
+  */
+  line_stepper(pid_t pid, thread_table &threads, object_index &index, register_cache &regs,
+               breakpoint_manager &breakpoints, bool by_line, bool skip_nodebug)
+  : pid(pid), threads(threads), index(index), regs(regs), breakpoints(breakpoints),
+    unwinder{index}, by_line{by_line}, skip_nodebug{skip_nodebug}
+  {}
+
+  /**
+  * handle a stop of a thread that was resumed by resume()
+  * @param  tid the stopped thread. Its instruction pointer is moved back
+  *             onto the breakpoint if one was hit.
+  * @return     true if the thread reached its next instruction or source
+  *             line and should be reported, false if the stop was
+  *             internal and the thread was already resumed
+  */
+  bool handle_stop(pid_t tid);
+
+  /**
+  * plan the next stop of a thread and resume it
+  * @param tid the stopped thread
+  */
+  void resume(pid_t tid);
+
+  /**
+  * resume a thread after a stop that is not part of its plan, such as a
+  *   signal or a ptrace event, without changing the plan
+  * @param tid the stopped thread
+  * @param sig the signal to deliver, or 0
+  */
+  void keep_going(pid_t tid, int sig);
+
+  /**
+  * forget a thread that exited, releasing its breakpoints
+  * @param tid the exited thread
+  */
+  void thread_exited(pid_t tid);
+
+private:
+  // How a thread is advanced to its next line
+  struct step_plan {
+    std::vector<intptr_t> breakpoints; // Breakpoints owned by this thread
+    bool single_step;                  // Whether the thread is single-stepped
+    const char* file;                  // Source file of the line being stepped
+    unsigned line;                     // Line being stepped, 0 if unknown
+  };
+
+  /**
+  * resume a stopped thread, applying the pending breakpoint changes and
+  *   forgetting its cached registers
+  * @param tid         the stopped thread
+  * @param single_step whether to stop after one instruction
+  * @param sig         the signal to deliver, or 0
+  */
+  void run(pid_t tid, bool single_step, int sig);
+
+  /**
+  * execute the original instruction under a breakpoint, stopping the other
+  *   running threads meanwhile so that none of them runs past it unseen
+  * @param  tid  a thread stopped at the breakpoint address
+  * @param  addr the breakpoint address
+  * @return      true if the thread is still stopped, false if it exited
+  */
+  bool step_over(pid_t tid, intptr_t addr);
+
+  /**
+  * release all the breakpoints of a thread's plan
+  * @param tid the thread whose plan is cleared
+  */
+  void clear_plan(pid_t tid);
+
+  /**
+  * find the return address of a thread's current function from its call
+  *   frame information, or else by scanning its stack for a word that
+  *   follows a call to that function
+  * @param  tid    the stopped thread
+  * @param  obj    the shared object containing the function
+  * @param  starts the system memory addresses of the function's ranges
+  * @return        the return address, or 0 if none was found
+  */
+  intptr_t find_return_address(pid_t tid, shared_obj *obj, const std::vector<intptr_t> &starts);
+
+  pid_t pid;                                             // The traced process
+  thread_table &threads;                                 // Traced threads
+  object_index &index;                                   // Shared object index
+  register_cache &regs;                                  // Registers of the traced threads
+  breakpoint_manager &breakpoints;                       // Breakpoints of the traced process
+  stack_unwinder unwinder;                               // Finds return addresses
+  bool by_line;                                          // Whether to advance by source line
+  bool skip_nodebug;                                     // Whether to run through code without debug information
+  std::unordered_map<pid_t, step_plan> plans;            // Plan of each thread
+  std::unordered_map<pid_t, size_t> hints;               // Object index hint of each thread
+};
+
+#endif /* _LINE_STEPPER_HH_ */
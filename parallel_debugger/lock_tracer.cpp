@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+
+#include <string>
+#include <unordered_set>
+
+#include "lock_tracer.hh"
+#include "process_memory.hh"
+
+// The traced functions, and the event reported when each one is called
+static const struct {
+  const char* name;
+  lock_event::kind type;
+} traced_functions[] = {
+  {"pthread_mutex_lock", lock_event::LOCK},
+  {"pthread_mutex_unlock", lock_event::UNLOCK},
+  {"pthread_create", lock_event::CREATE},
+  {"pthread_join", lock_event::JOIN}
+};
+
+/**
+* insert breakpoints on the traced functions. Each function is looked up
+*   in the symbol tables of the loaded files, preferring libpthread.
+* @param  objects the shared objects mapped in the traced process
+* @return         the number of traced functions found
+*/
+size_t lock_tracer::attach(std::vector<shared_obj> &objects) {
+  size_t found = 0;
+  for (auto &function : traced_functions) {
+    intptr_t addr = 0;
+    bool in_pthread = false;
+
+    // Search every file once. Before glibc 2.34, libc also defines some
+    //   pthread functions, as stubs that forward to libpthread.
+    std::unordered_set<debug_info*> searched;
+    for (auto &obj : objects) {
+      if (!searched.insert(obj.get_info().get()).second) {
+        continue;
+      }
+      uint64_t file_addr;
+      if (!obj.get_info()->find_function_symbol(function.name, file_addr)) {
+        continue;
+      }
+      std::string path = obj.get_path();
+      bool is_pthread = path.compare(path.find_last_of('/') + 1, 10, "libpthread") == 0;
+      if (addr == 0 || (is_pthread && !in_pthread)) {
+        addr = obj.obj_off_to_sys_mem(file_addr);
+        in_pthread = is_pthread;
+      }
+    }
+
+    if (addr != 0) {
+      entries[addr] = function.type;
+      breakpoints.insert(addr);
+      found++;
+    }
+  }
+  breakpoints.flush();
+  return found;
+}
+
+/**
+* decode a SIGTRAP stop of a thread running at full speed
+* @param  tid   the stopped thread. Its instruction pointer is moved back
+*               onto the breakpoint if one was hit.
+* @param  event set to the event, if one is returned
+* @return       true if the thread stopped at a traced call or return,
+*               false otherwise
+*/
+bool lock_tracer::handle_stop(pid_t tid, lock_event &event) {
+  // The breakpoint may have been released by another thread since
+  intptr_t addr = regs.get_ip(tid) - 1;
+  if (!breakpoints.is_breakpoint_stop(tid, addr)) {
+    return false;
+  }
+  regs.set_ip(tid, addr);
+  on_breakpoint[tid] = addr;
+
+  // One of the thread's pending calls returned. Calls left by longjmp or
+  //   cancellation never return, so the innermost one may not be the one.
+  std::vector<pending_call> &calls = pending[tid];
+  for (size_t i = calls.size(); i-- > 0; ) {
+    if (calls[i].event.call_site != addr) {
+      continue;
+    }
+    event = calls[i].event;
+    if (event.type == lock_event::CREATE) {
+      event.type = lock_event::CREATED;
+      event.object = 0;
+      read_memory(tid, calls[i].result, &event.object, sizeof(event.object));
+    } else {
+      event.type = event.type == lock_event::LOCK ? lock_event::ACQUIRED : lock_event::JOINED;
+    }
+    for (size_t j = i; j < calls.size(); j++) {
+      breakpoints.remove(calls[j].event.call_site);
+    }
+    calls.resize(i);
+    return true;
+  }
+
+  // Otherwise, this may be the return breakpoint of another thread
+  auto entry = entries.find(addr);
+  if (entry == entries.end()) {
+    return false;
+  }
+
+  // At the entry point, the return address is on top of the stack
+  event.type = entry->second;
+  event.tid = tid;
+  event.object = regs.get_arg(tid, event.type == lock_event::CREATE ? 2 : 0);
+  uint64_t ret = 0;
+  read_memory(tid, regs.get_sp(tid), &ret, sizeof(ret));
+  event.call_site = ret;
+
+  if (event.type != lock_event::UNLOCK) {
+    // pthread_create(thread, attr, start_routine, arg) stores the new
+    //   pthread_t in *thread
+    uintptr_t result = event.type == lock_event::CREATE ? regs.get_arg(tid, 0) : 0;
+    calls.push_back(pending_call{event, result});
+    breakpoints.insert(ret);
+  }
+  return true;
+}
+
+/**
+* continue a stopped thread, first executing the instruction under the
+*   breakpoint it stopped at, if any
+* @param  tid the stopped thread
+* @param  sig the signal to deliver, or 0
+* @return     true if the thread was resumed, false if it exited while
+*             stepping over the breakpoint
+*/
+bool lock_tracer::resume(pid_t tid, int sig) {
+  breakpoints.flush();
+  regs.invalidate(tid);
+
+  auto it = on_breakpoint.find(tid);
+  if (it != on_breakpoint.end()) {
+    intptr_t addr = it->second;
+    on_breakpoint.erase(it);
+    if (!breakpoints.step_over(tid, addr)) {
+      thread_exited(tid);
+      return false;
+    }
+  }
+  ptrace(PTRACE_CONT, tid, NULL, sig);
+  return true;
+}
+
+/**
+* forget a thread that exited, releasing its return breakpoints
+* @param tid the exited thread
+*/
+void lock_tracer::thread_exited(pid_t tid) {
+  auto calls = pending.find(tid);
+  if (calls != pending.end()) {
+    for (auto &call : calls->second) {
+      breakpoints.remove(call.event.call_site);
+    }
+    pending.erase(calls);
+  }
+  on_breakpoint.erase(tid);
+}
+
+/**
+* @param  type the kind of an event
+* @return      the event's name, as printed in reports
+*/
+const char* lock_tracer::get_name(lock_event::kind type) {
+  switch (type) {
+    case lock_event::LOCK:     return "lock";
+    case lock_event::ACQUIRED: return "acquired";
+    case lock_event::UNLOCK:   return "unlock";
+    case lock_event::CREATE:   return "create";
+    case lock_event::CREATED:  return "created";
+    case lock_event::JOIN:     return "join";
+    default:                   return "joined";
+  }
+}
@@ -0,0 +1,115 @@
+#ifndef _LOCK_TRACER_HH_
+#define _LOCK_TRACER_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "breakpoint_manager.hh"
+#include "register_cache.hh"
+#include "shared_object.hh"
+
+// A call to a traced pthread function, or its return
+struct lock_event {
+  enum kind {
+    LOCK,     // pthread_mutex_lock was called
+    ACQUIRED, // pthread_mutex_lock returned
+    UNLOCK,   // pthread_mutex_unlock was called
+    CREATE,   // pthread_create was called
+    CREATED,  // pthread_create returned
+    JOIN,     // pthread_join was called
+    JOINED    // pthread_join returned
+  } type;
+  pid_t tid;          // Calling thread
+  uintptr_t object;   // Mutex address, start routine of the new thread
+                      //   (CREATE), or pthread_t of the new or joined thread
+  intptr_t call_site; // Return address of the call
+};
+
+/**
+ * Traces the synchronization of a program with breakpoints on the entry
+ *   points of pthread_mutex_lock, pthread_mutex_unlock, pthread_create and
+ *   pthread_join, so that threads run at full speed between events. The
+ *   calls that may block, and pthread_create, also get a breakpoint at their
+ *   return address, to report when the lock was acquired, the thread joined,
+ *   or the new thread's pthread_t is known. These calls nest, since
+ *   pthread_create itself locks mutexes.
+ */
+class lock_tracer {
+public:
+
+  /**
+  * construct a new lock tracer
+  * @param regs        the registers of the traced threads
+  * @param breakpoints the breakpoints of the traced process
+  */
+  lock_tracer(register_cache &regs, breakpoint_manager &breakpoints)
+  : regs(regs), breakpoints(breakpoints)
+  {}
+
+  /**
+  * insert breakpoints on the traced functions. Each function is looked up
+  *   in the symbol tables of the loaded files, preferring libpthread.
+  * @param  objects the shared objects mapped in the traced process
+  * @return         the number of traced functions found
+  */
+  size_t attach(std::vector<shared_obj> &objects);
+
+  /**
+  * decode a SIGTRAP stop of a thread running at full speed
+  * @param  tid   the stopped thread. Its instruction pointer is moved back
+  *               onto the breakpoint if one was hit.
+  * @param  event set to the event, if one is returned
+  * @return       true if the thread stopped at a traced call or return,
+  *               false otherwise
+  */
+  bool handle_stop(pid_t tid, lock_event &event);
+
+  /**
+  * continue a stopped thread, first executing the instruction under the
+  *   breakpoint it stopped at, if any
+  * @param  tid the stopped thread
+  * @param  sig the signal to deliver, or 0
+  * @return     true if the thread was resumed, false if it exited while
+  *             stepping over the breakpoint
+  */
+  bool resume(pid_t tid, int sig);
+
+  /**
+  * @param  tid a stopped thread
+  * @return     true if the thread stopped at one of the breakpoints, which
+  *             resume() steps it over, false otherwise
+  */
+  bool at_breakpoint(pid_t tid) const { return on_breakpoint.count(tid) != 0; }
+
+  /**
+  * forget a thread that exited, releasing its return breakpoints
+  * @param tid the exited thread
+  */
+  void thread_exited(pid_t tid);
+
+  /**
+  * @param  type the kind of an event
+  * @return      the event's name, as printed in reports
+  */
+  static const char* get_name(lock_event::kind type);
+
+private:
+  // A call waiting for its return breakpoint
+  struct pending_call {
+    lock_event event;   // The event reported at the call
+    uintptr_t result;   // Where pthread_create stores the new pthread_t
+  };
+
+  register_cache &regs;                                 // Registers of the traced threads
+  breakpoint_manager &breakpoints;                      // Breakpoints of the traced process
+  std::unordered_map<intptr_t, lock_event::kind> entries; // Traced entry points
+  std::unordered_map<pid_t, std::vector<pending_call>> pending; // Pending calls of each
+                                                        //   thread, innermost last
+  std::unordered_map<pid_t, intptr_t> on_breakpoint;    // Breakpoint each thread stopped at
+};
+
+#endif /* _LOCK_TRACER_HH_ */
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "object_index.hh"
+
+/**
+* build the index over a set of shared objects. The objects are referenced,
+*   not copied, so the vector must not be resized while the index is in use.
+* @param objects the shared objects parsed from the traced process' maps file
+*/
+void object_index::build(std::vector<shared_obj> &objects) {
+  std::vector<shared_obj*> sorted;
+  for (auto &obj : objects) {
+    sorted.push_back(&obj);
+  }
+
+  // Sort ranges by their start address
+  std::sort(sorted.begin(), sorted.end(), [](shared_obj *a, shared_obj *b) {
+    return a->get_start() < b->get_start();
+  });
+
+  starts.clear();
+  ends.clear();
+  objs.clear();
+  for (auto obj : sorted) {
+    // Mappings never overlap, but drop any range that would break the
+    //   binary search invariant
+    if (!ends.empty() && obj->get_start() < ends.back()) {
+      continue;
+    }
+    starts.push_back(obj->get_start());
+    ends.push_back(obj->get_end());
+    objs.push_back(obj);
+  }
+}
+
+/**
+* add a shared object mapped after the index was built. The object is
+*   referenced, not copied.
+* @param  obj the shared object
+* @return     true if it was added, false if its range overlaps another's
+*/
+bool object_index::insert(shared_obj *obj) {
+  // The first range starting after the new one
+  auto it = std::upper_bound(starts.begin(), starts.end(), obj->get_start());
+  size_t slot = it - starts.begin();
+  if ((slot > 0 && obj->get_start() < ends[slot - 1])
+      || (slot < starts.size() && starts[slot] < obj->get_end())) {
+    return false;
+  }
+  starts.insert(it, obj->get_start());
+  ends.insert(ends.begin() + slot, obj->get_end());
+  objs.insert(objs.begin() + slot, obj);
+  return true;
+}
+
+/**
+* remove a shared object that was unmapped
+* @param obj the shared object
+*/
+void object_index::erase(shared_obj *obj) {
+  auto it = std::lower_bound(starts.begin(), starts.end(), obj->get_start());
+  size_t slot = it - starts.begin();
+  if (slot < objs.size() && objs[slot] == obj) {
+    starts.erase(it);
+    ends.erase(ends.begin() + slot);
+    objs.erase(objs.begin() + slot);
+  }
+}
+
+/**
+* find the shared object whose address range contains an instruction pointer
+* @param  ip   the instruction pointer to be looked up
+* @param  hint the slot of the last object found by this caller. It is
+*              checked first and updated on every successful lookup, so
+*              each thread should keep its own hint.
+* @return      the owning shared object, or nullptr if ip is not mapped
+*/
+shared_obj* object_index::find(intptr_t ip, size_t &hint) {
+  // Fast path: threads usually stay within the same object
+  if (hint < objs.size() && starts[hint] <= ip && ip < ends[hint]) {
+    return objs[hint];
+  }
+
+  // Find the last range starting at or before ip
+  auto it = std::upper_bound(starts.begin(), starts.end(), ip);
+  if (it == starts.begin()) {
+    return nullptr;
+  }
+  size_t slot = (it - starts.begin()) - 1;
+  if (ip >= ends[slot]) {
+    return nullptr;
+  }
+
+  hint = slot;
+  return objs[slot];
+}
@@ -0,0 +1,56 @@
+#ifndef _OBJECT_INDEX_HH_
+#define _OBJECT_INDEX_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "shared_object.hh"
+
+class object_index {
+public:
+
+  /**
+  * build the index over a set of shared objects. The objects are referenced,
+  *   not copied, so the vector must not be resized while the index is in use.
+  * @param objects the shared objects parsed from the traced process' maps file
+  */
+  void build(std::vector<shared_obj> &objects);
+
+  /**
+  * add a shared object mapped after the index was built. The object is
+  *   referenced, not copied.
+  * @param  obj the shared object
+  * @return     true if it was added, false if its range overlaps another's
+  */
+  bool insert(shared_obj *obj);
+
+  /**
+  * remove a shared object that was unmapped
+  * @param obj the shared object
+  */
+  void erase(shared_obj *obj);
+
+  /**
+  * find the shared object whose address range contains an instruction pointer
+  * @param  ip   the instruction pointer to be looked up
+  * @param  hint the slot of the last object found by this caller. It is
+  *              checked first and updated on every successful lookup, so
+  *              each thread should keep its own hint.
+  * @return      the owning shared object, or nullptr if ip is not mapped
+  */
+  shared_obj* find(intptr_t ip, size_t &hint);
+
+  /**
+  * @return the number of address ranges in the index
+  */
+  auto size() const -> size_t { return objs.size(); }
+
+private:
+  std::vector<intptr_t> starts;   // Start address of each range, sorted
+  std::vector<intptr_t> ends;     // End address (exclusive) of each range
+  std::vector<shared_obj*> objs;  // Object owning each range
+};
+
+#endif /* _OBJECT_INDEX_HH_ */
@@ -6,39 +6,71 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <link.h>
+#include <signal.h>
 #include <stdio.h>
+#include <sys/personality.h>
 #include <sys/ptrace.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/user.h>
 #include <stdint.h>
+#include <time.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "elf++.hh"
 #include "dwarf++.hh"
-#include "breakpoint.hh"
+#include "breakpoint_manager.hh"
+#include "deadlock_detector.hh"
+#include "debug_info.hh"
+#include "library_tracker.hh"
+#include "line_coverage.hh"
+#include "line_stepper.hh"
+#include "lock_tracer.hh"
+#include "object_index.hh"
+#include "process_memory.hh"
+#include "race_detector.hh"
+#include "register_cache.hh"
+#include "sampling_profiler.hh"
+#include "scheduler.hh"
 #include "shared_object.hh"
+#include "stack_unwinder.hh"
+#include "thread_table.hh"
+#include "trace_file.hh"
+#include "trace_pipeline.hh"
+#include "watchpoint_set.hh"
 
 using dwarf::compilation_unit;
+using std::unordered_map;
+using std::unordered_set;
 using std::vector;
 using std::string;
 
 /**
  * Parses a /proc/<pid>/maps file to determine the virtual memory locations of
  * the shared objects linked to the main executable, and stores that information
- * in the given shared_obj vector.
+ * in the given shared_obj vector. Each file is parsed only once, no matter how
+ * many of its segments are mapped.
  * @param  child   the pid of the process traced being
  * @param  objects a vector to store the parsed information
+ * @param  cache   the parsed files, shared by all their mappings
  * @return         0 if the maps file was processed correctly, 0 on failure.
  * Source:
  * https://stackoverflow.com/questions/36523584/how-to-see-memory-layout-of-my-program-in-c-during-run-time/36524010
  */
-int populate_shared_objs(pid_t child, vector<shared_obj> &objects) {
+int populate_shared_objs(pid_t child, vector<shared_obj> &objects, debug_info_cache &cache) {
   char* line = NULL;
   size_t size = 0;
 
@@ -72,19 +104,19 @@ int populate_shared_objs(pid_t child, vector<shared_obj> &objects) {
     }
 
     string name;
-    // Check for valid name
-    if (name_end > name_start)  {
+    // Check for valid name. Pseudo-files such as [heap] or [vdso] start with
+    //   a '[' and have no file to parse.
+    if (name_end > name_start && line[name_start] == '/')  {
       name = string (line + name_start, name_end - name_start);
 
-      /* Create a new shared object from this entry */
-      try {
-        shared_obj obj (name, addr_start, addr_end);
+      /* Find (or parse, on first use) the file mapped by this entry */
+      auto info = cache.get(name, ((unsigned long)devmajor << 32) | devminor, inode);
 
-        // Add object to vector
-        objects.push_back(obj);
-      } catch(std::invalid_argument &e) {
-        // shared_obj will throw an exception when name is not a valid file,
-        //   which we can safely ignore
+      // The cache returns nullptr when name is not a valid file, which we can
+      //   safely ignore
+      if (info) {
+        /* Create a new shared object from this entry */
+        objects.push_back(shared_obj (info, addr_start, addr_end, offset));
       }
     }
   } /* end of while */
@@ -98,11 +130,12 @@ int populate_shared_objs(pid_t child, vector<shared_obj> &objects) {
 /**
 * Sets a break point at the child's main function, and advances the child's
 * execution until the main function is reached.
-* @param child    the pid of the traced process
-* @param main_obj the shared object corresponding to the file containing the
-*                 child's main function
+* @param child       the pid of the traced process
+* @param main_obj    the shared object corresponding to the file containing the
+*                    child's main function
+* @param breakpoints the breakpoints of the traced process
 */
-void break_at_main(pid_t child, shared_obj &main_obj) {
+void break_at_main(pid_t child, shared_obj &main_obj, breakpoint_manager &breakpoints) {
   // To store debuggee status
   struct user_regs_struct regs;
 
@@ -118,8 +151,9 @@ void break_at_main(pid_t child, shared_obj &main_obj) {
   }
 
   // Set breakpoint
-  breakpoint bp {child, main_obj.obj_off_to_sys_mem(main_entry.address)};
-  bp.enable();
+  intptr_t main_addr = main_obj.obj_off_to_sys_mem(main_entry.address);
+  breakpoints.insert(main_addr);
+  breakpoints.flush();
 
   // Continue until we reach the breakpoint
   intptr_t prev_ip;
@@ -148,57 +182,571 @@ void break_at_main(pid_t child, shared_obj &main_obj) {
   ptrace(PTRACE_SETREGS, child, NULL, &regs);
 
   // restore breakpoint instruction
-  bp.disable();
+  breakpoints.remove(main_addr);
+  breakpoints.flush();
 }
 
 /**
-* Given an instruction pointer and its object, find line info
-* @param  obj a shared object entry
-* @param  rip instruction pointer
-* @return     true if the line is found, false otherwise
+* Resolves a --watch argument to a range of the child's memory
+* @param  spec    a global variable name, a local variable of the function
+*                 the child is stopped in or one of its members, as in
+*                 main:counter or main:args.count, or an address followed
+*                 by an optional number of bytes, as in 0x601040:4
+* @param  objects the child's shared objects
+* @param  child   the child, stopped
+* @param  regs    the registers of the child's threads
+* @param  addr    set to the first byte of the range
+* @param  size    set to the number of bytes in the range
+* @return         true if the argument was resolved, false otherwise
 */
-bool print_line_info(shared_obj &obj, intptr_t rip) {
-  /* return value set to false */
-  bool found = false;
+bool resolve_watch(const char* spec, vector<shared_obj> &objects, pid_t child,
+                   register_cache &regs, intptr_t &addr, size_t &size) {
+  // Addresses watch a single byte unless told otherwise
+  if (spec[0] >= '0' && spec[0] <= '9') {
+    char* end;
+    addr = strtoull(spec, &end, 0);
+    size = 1;
+    if (*end == ':') {
+      size = strtoul(end + 1, &end, 0);
+    }
+    return *end == '\0' && size > 0;
+  }
 
-  /* if the object has line table */
-  if (obj.has_cus())  {
-    try {
-      auto entry = obj.get_line_entry_from_ip(rip);
-      /* If we find the line, print it */
-      printf("File path: %s\n", entry->file->path.c_str());
-      printf("Called from line %u\n\n", entry->line);
-      found = true;
-    } catch(std::out_of_range &e) {
-      /* Line was not found */
-      printf("File path: %s\n", obj.get_path().c_str());
-      printf("No line numbers found.\n\n");
+  // A local variable lives in the frame of the function the child is
+  //   stopped in, and is found from the frame's CFA
+  const char* colon = strchr(spec, ':');
+  if (colon != NULL) {
+    string function {spec, (size_t)(colon - spec)};
+    intptr_t ip = regs.get_ip(child);
+    for (auto &obj : objects) {
+      if (!obj.contains(ip) || !obj.has_cus()) {
+        continue;
+      }
+      function_entry entry;
+      uint64_t off = obj.sys_mem_to_obj_off(ip);
+      int64_t offset;
+      uint64_t var_size;
+      frame_row row;
+      if (!obj.get_info()->find_function(function, entry) || off < entry.low
+          || (entry.high > entry.low && off >= entry.high)
+          || !obj.get_info()->find_local_variable(function, colon + 1, offset, var_size)) {
+        return false;
+      }
+      intptr_t cfa;
+      if (obj.get_info()->get_frames().find(off, row) && row.cfa_rule == frame_rule::REGISTER
+          && (row.cfa_reg == DWARF_REG_RSP || row.cfa_reg == DWARF_REG_RBP)) {
+        cfa = (row.cfa_reg == DWARF_REG_RSP ? regs.get_sp(child) : regs.get_fp(child))
+              + row.cfa_offset;
+      } else if (off == entry.low) {
+        // At the entry point, the return address is on top of the stack
+        cfa = regs.get_sp(child) + sizeof(uint64_t);
+      } else {
+        return false;
+      }
+      addr = cfa + offset;
+      size = var_size > 0 ? var_size : 1;
+      return true;
     }
-  } else {
-    printf("File path: %s\n", obj.get_path().c_str());
-    printf("No debug information available.\n\n");
+    return false;
+  }
+
+  // Search the debugging information of every file, once per file
+  unordered_set<debug_info*> searched;
+  for (auto &obj : objects) {
+    if (!searched.insert(obj.get_info().get()).second || !obj.has_cus()) {
+      continue;
+    }
+    uint64_t file_addr, var_size;
+    if (obj.get_info()->find_variable(spec, file_addr, var_size)) {
+      addr = obj.obj_off_to_sys_mem(file_addr);
+      size = var_size > 0 ? var_size : 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+* Prints the source line of the instruction ending at an address, such as a
+*   call given its return address, or an access that triggered a watchpoint
+* @param  out   the stream to print to
+* @param  index the address index of the child's shared objects
+* @param  end   the address following the instruction
+* @return       true if the line is found, false otherwise
+*/
+bool print_line_before(FILE* out, object_index &index, intptr_t end) {
+  size_t hint = 0;
+  shared_obj *obj = index.find(end - 1, hint);
+  if (obj == nullptr) {
+    fprintf(out, "\n");
+    return false;
+  }
+  return print_line_info(out, *obj, end - 1);
+}
+
+/**
+* Prints a call stack, one frame per line, with the function and the source
+*   line of each frame
+* @param out    the stream to print to
+* @param frames the current instruction pointer, followed by the return
+*               address of each caller
+* @param index  the address index of the child's shared objects
+*/
+void print_backtrace(FILE* out, const vector<intptr_t> &frames, object_index &index) {
+  size_t hint = 0;
+  for (size_t i = 0; i < frames.size(); i++) {
+    // Callers are in the middle of their call instruction
+    intptr_t addr = i > 0 ? frames[i] - 1 : frames[i];
+    shared_obj *obj = index.find(addr, hint);
+    if (obj == nullptr) {
+      fprintf(out, "  #%-2zu %lx in ?? (unknown object)\n", i, frames[i]);
+      continue;
+    }
+
+    string name;
+    if (!obj->get_info()->find_function_name(obj->sys_mem_to_obj_off(addr), name)) {
+      name = "??";
+    }
+    fprintf(out, "  #%-2zu %lx in %s (%s)", i, frames[i], name.c_str(), obj->get_path().c_str());
+    if (obj->has_cus()) {
+      try {
+        auto entry = obj->get_line_entry_from_ip(addr);
+        fprintf(out, " at %s:%u", entry.file, entry.line);
+      } catch(std::out_of_range &e) {
+        /* Line was not found */
+      }
+    }
+    fprintf(out, "\n");
+  }
+  fprintf(out, "\n");
+}
+
+// Frames printed by the interactive "where" command, at most
+#define BACKTRACE_FRAMES 64
+
+// Frames of each blocked thread printed in deadlock reports, at most
+#define DEADLOCK_FRAMES 16
+
+/**
+* Waits for the user to press enter before the next stop. Entering "where"
+*   or "bt" first prints the call stack of the stopped thread.
+* @param out      the stream to print to
+* @param tid      the stopped thread
+* @param regs     the registers of the traced threads
+* @param unwinder walks the stopped thread's stack
+* @param index    the address index of the child's shared objects
+*/
+void wait_for_user(FILE* out, pid_t tid, register_cache &regs, stack_unwinder &unwinder,
+                   object_index &index) {
+  char* line = NULL;
+  size_t size = 0;
+  while (getline(&line, &size, stdin) > 0) {
+    char command[16];
+    if (sscanf(line, "%15s", command) != 1
+        || (strcmp(command, "where") != 0 && strcmp(command, "bt") != 0)) {
+      break;
+    }
+    vector<intptr_t> frames;
+    unwinder.unwind(tid, regs, frames, BACKTRACE_FRAMES);
+    fprintf(out, "Thread ID (PID): %d | Call stack:\n", tid);
+    print_backtrace(out, frames, index);
+    fflush(out);
   }
-  return found;
+  free(line);
 }
 
+/**
+* Prints the threads of a deadlock or of a stall: the line and call stack
+*   where each thread is blocked, and the line where the thread it waits for
+*   acquired the mutex
+* @param out    the stream to print to
+* @param title  what was detected
+* @param links  the blocked threads
+* @param stacks the call stack of each thread at its last blocking call
+* @param index  the address index of the child's shared objects
+*/
+void print_deadlock(FILE* out, const char* title, const vector<deadlock_link> &links,
+                    const unordered_map<pid_t, vector<intptr_t>> &stacks, object_index &index) {
+  fprintf(out, "%s\n\n", title);
+  for (auto &link : links) {
+    fprintf(out, "Thread ID (PID): %d | Blocked for %lu ms in %s %#lx | Call site: %lx\n",
+            link.tid, link.waited_ms, lock_tracer::get_name(link.type),
+            (unsigned long)link.object, link.blocked_at);
+    print_line_before(out, index, link.blocked_at);
+    auto stack = stacks.find(link.tid);
+    if (stack != stacks.end()) {
+      fprintf(out, "Call stack:\n");
+      print_backtrace(out, stack->second, index);
+    }
+    if (link.holder != 0 && link.type == lock_event::LOCK) {
+      fprintf(out, "Thread ID (PID): %d | Holds %#lx%s | Call site: %lx\n", link.holder,
+              (unsigned long)link.object, link.holder_exited ? " (exited)" : "", link.acquired_at);
+      print_line_before(out, index, link.acquired_at);
+    } else if (link.holder != 0) {
+      fprintf(out, "Thread ID (PID): %d | Being joined\n\n", link.holder);
+    }
+  }
+  fflush(out);
+}
+
+/**
+* Prints a data race: the two accesses, with their source lines
+* @param out   the stream to print to
+* @param race  the race
+* @param wp    the location of the race
+* @param index the address index of the child's shared objects
+*/
+void print_race(FILE* out, const race_report &race, const watchpoint &wp, object_index &index) {
+  fprintf(out, "Data race on %s at %lx:\n\n", wp.label.c_str(), wp.addr);
+  fprintf(out, "Thread ID (PID): %d | %s | Instruction address: %lx\n", race.tid,
+          race.write ? "Write" : "Read", race.ip);
+  print_line_before(out, index, race.ip);
+  fprintf(out, "Thread ID (PID): %d | Earlier %s | Instruction address: %lx\n", race.prev_tid,
+          race.prev_write ? "write" : "read", race.prev_ip);
+  print_line_before(out, index, race.prev_ip);
+  fflush(out);
+}
+
+// How long --deadlock lets a thread wait before reporting it, by default
+#define DEADLOCK_STALL_MS 1000
+
+// How long the thread chosen by --schedule may run without stopping before
+//   it is considered blocked
+#define SCHEDULE_TIMEOUT_MS 20
+
+// The same in lock mode, where threads run freely between pthread calls and
+//   waits for mutexes are found from the lock events instead
+#define SCHEDULE_LOCK_TIMEOUT_MS 200
+
+// Samples per second of --profile, by default and at most. Waits for events
+//   are in whole milliseconds, which bounds the frequency.
+#define PROFILE_HZ 1000
+#define MAX_PROFILE_HZ 1000
+
+/**
+* Runs a program at full speed, sampling where its threads are, and prints
+*   the hottest functions and lines once it exits
+* @param  inputs the program path, followed by its arguments
+* @param  hz     the number of samples per second
+* @param  out    the stream to print the report to
+* @return        the exit status of the debugger
+*/
+int run_profile(char** inputs, unsigned hz, FILE* out) {
+  pid_t child = fork();
+  if (child == -1) {
+    perror("Failed to fork process");
+    exit(EXIT_FAILURE);
+  } else if (child == 0) {
+    // Wait to be attached, so that no instruction of the program is missed
+    raise(SIGSTOP);
+    execv(inputs[0], inputs);
+    perror("Failed to execute the program");
+    _exit(EXIT_FAILURE);
+  }
+
+  // PTRACE_SEIZE, unlike PTRACE_TRACEME, allows PTRACE_INTERRUPT
+  int status;
+  if (waitpid(child, &status, WUNTRACED) == -1) {
+    perror("Error in waitpid");
+    exit(EXIT_FAILURE);
+  }
+  if (ptrace(PTRACE_SEIZE, child, NULL, PTRACE_O_TRACECLONE | PTRACE_O_TRACEFORK
+             | PTRACE_O_TRACEVFORK | PTRACE_O_TRACEEXEC | PTRACE_O_TRACEEXIT
+             | PTRACE_O_EXITKILL) == -1) {
+    perror("Failed to attach to the program");
+    exit(EXIT_FAILURE);
+  }
+
+  thread_table threads {step_mode::FREE};
+  threads.add(child, thread_state::RUNNING);
+  register_cache regs {reg_strategy::PEEKUSER};
+  sampling_profiler profiler {threads, regs, child, hz};
+
+  fprintf(out, "Profiling '%s' at %u Hz\n\n", inputs[0], hz);
+  fflush(out);
+  kill(child, SIGCONT);
+
+  // Libraries may be loaded at any time, so the mappings are read when
+  //   the main thread exits, while they still exist
+  vector<shared_obj> shared_objs;
+  debug_info_cache debug_infos;
+  while (profiler.run()) {
+    shared_objs.clear();
+    if (populate_shared_objs(child, shared_objs, debug_infos)) {
+      shared_objs.clear();
+    }
+  }
+
+  object_index index;
+  index.build(shared_objs);
+  fprintf(out, "\nProgram '%s' terminated.\n\n", inputs[0]);
+  profiler.print_report(out, index);
+  return 0;
+}
+
+/**
+* Runs a program at full speed with a one-shot breakpoint on each source
+*   line of the objects with debug information, and reports which lines it
+*   executed once it exits
+* @param  inputs the program path, followed by its arguments
+* @param  report the stream to print the annotated sources to
+* @param  out    the stream to print the summary to
+* @return        the exit status of the debugger
+*/
+int run_coverage(char** inputs, FILE* report, FILE* out) {
+  pid_t child = fork();
+  if (child == -1) {
+    perror("Failed to fork process");
+    exit(EXIT_FAILURE);
+  } else if (child == 0) {
+    ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+    execv(inputs[0], inputs);
+    perror("Failed to execute the program");
+    _exit(EXIT_FAILURE);
+  }
+
+  int status;
+  if (waitpid(child, &status, 0) == -1) {
+    perror("Error in waitpid");
+    exit(EXIT_FAILURE);
+  }
+  ptrace(PTRACE_SETOPTIONS, child, NULL, PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE);
+
+  vector<shared_obj> shared_objs;
+  debug_info_cache debug_infos;
+  if (populate_shared_objs(child, shared_objs, debug_infos)) {
+    perror("Failed to parse child's map file.");
+    exit(EXIT_FAILURE);
+  }
+
+  std::unique_ptr<breakpoint_manager> breakpoints;
+  try {
+    breakpoints.reset(new breakpoint_manager{child});
+  } catch(std::runtime_error &e) {
+    fprintf(stderr, "%s\n", e.what());
+    exit(EXIT_FAILURE);
+  }
+
+  // The libraries are mapped on the way to main, so the maps file is read
+  //   again there, and their lines are broken on from main on
+  break_at_main(child, shared_objs[0], *breakpoints);
+  shared_objs.clear();
+  if (populate_shared_objs(child, shared_objs, debug_infos)) {
+    perror("Failed to parse child's map file.");
+    exit(EXIT_FAILURE);
+  }
+  try {
+    debug_infos.preload(std::max(1u, std::thread::hardware_concurrency()));
+  } catch(std::system_error &e) {
+    // The tables are built on first use instead
+  }
+
+  register_cache regs {reg_strategy::PEEKUSER};
+  line_coverage coverage {child, regs, *breakpoints};
+  size_t num_lines = coverage.attach(shared_objs);
+
+  // The lines of main before the breakpoint at main were executed
+  function_entry main_function;
+  if (shared_objs[0].get_info()->find_function("main", main_function)) {
+    coverage.mark_executed(shared_objs[0].obj_off_to_sys_mem(main_function.low),
+                           regs.get_ip(child));
+  }
+
+  thread_table threads {step_mode::FREE};
+  threads.add(child, thread_state::RUNNING);
+
+  fprintf(out, "Recording the coverage of %zu lines of '%s'\n\n", num_lines, inputs[0]);
+  fflush(out);
+  regs.invalidate(child);
+  if (ptrace(PTRACE_CONT, child, NULL, NULL) == -1) {
+    perror("Error in ptrace");
+    exit(EXIT_FAILURE);
+  }
+
+  // Threads only stop at the breakpoints of lines not executed yet, and
+  //   for signals and ptrace events
+  thread_event event;
+  while (threads.next_event(event, -1) >= 0) {
+    pid_t current = event.tid;
+    if (event.type == thread_event::EXITED) {
+      regs.thread_exited(current);
+      continue;
+    }
+    // A SIGTRAP that is not at one of the breakpoints is the program's own
+    int sig = event.type == thread_event::SIGNAL ? event.sig : 0;
+    if (event.type == thread_event::TRAP && !coverage.handle_stop(current)) {
+      sig = SIGTRAP;
+    }
+    threads.find(current)->state = thread_state::RUNNING;
+    regs.invalidate(current);
+    ptrace(PTRACE_CONT, current, NULL, sig);
+  }
+
+  fprintf(out, "Program '%s' terminated.\n\n", inputs[0]);
+  coverage.print_summary(out);
+  coverage.print_report(report);
+  fflush(report);
+  return 0;
+}
+
+// Most worker threads --workers may start
+#define MAX_WORKERS 64
+
+// Size of the output buffer used in --trace mode
+#define TRACE_BUFFER_SIZE (1 << 20)
+
 int main(int argc, char** argv)  {
 
+  /* Parse command line options */
+  bool next_mode = false;     // Advance by source line instead of by instruction
+  bool skip_nodebug = false;  // Run through code without debug information
+  bool batch = false;         // Run to completion without waiting for input
+  FILE* out = stdout;         // Where stops are printed
+  const char* binary_path = NULL; // Where stops are recorded in binary form
+  reg_strategy strategy = reg_strategy::PEEKUSER; // How registers are fetched
+  vector<const char*> watch_specs; // Variables or addresses to watch
+  std::unique_ptr<schedule_policy> policy; // Runs one thread at a time if set
+  bool lock_mode = false;     // Report pthread calls instead of stepping
+  unsigned long stall_ms = 0; // Detect deadlocks, reporting waits this long
+  vector<const char*> race_specs; // Variables or addresses checked for races
+  unsigned num_workers = 0;   // Threads symbolizing --trace stops, if any
+  unsigned profile_hz = 0;    // Sample the program at this rate instead of tracing it
+  FILE* coverage = NULL;      // Where the --coverage report is printed, if set
+  int prog = 1;
+  while (prog < argc && strncmp(argv[prog], "--", 2) == 0) {
+    if (strcmp(argv[prog], "--next") == 0) {
+      next_mode = true;
+    } else if (strcmp(argv[prog], "--skip-nodebug") == 0) {
+      skip_nodebug = true;
+    } else if (strcmp(argv[prog], "--trace") == 0
+               || strncmp(argv[prog], "--trace=", 8) == 0) {
+      batch = true;
+      if (argv[prog][7] == '=') {
+        out = fopen(argv[prog] + 8, "we");
+        if (out == NULL) {
+          perror("Failed to open trace file");
+          exit(EXIT_FAILURE);
+        }
+      }
+    } else if (strncmp(argv[prog], "--binary-trace=", 15) == 0) {
+      batch = true;
+      binary_path = argv[prog] + 15;
+    } else if (strncmp(argv[prog], "--regs=", 7) == 0) {
+      if (!register_cache::parse_strategy(argv[prog] + 7, strategy)) {
+        fprintf(stderr, "Unknown register access '%s'\n", argv[prog] + 7);
+        exit(EXIT_FAILURE);
+      }
+    } else if (strncmp(argv[prog], "--watch=", 8) == 0) {
+      watch_specs.push_back(argv[prog] + 8);
+    } else if (strncmp(argv[prog], "--race=", 7) == 0) {
+      lock_mode = true;
+      race_specs.push_back(argv[prog] + 7);
+    } else if (strcmp(argv[prog], "--locks") == 0) {
+      lock_mode = true;
+    } else if (strcmp(argv[prog], "--deadlock") == 0
+               || strncmp(argv[prog], "--deadlock=", 11) == 0) {
+      lock_mode = true;
+      stall_ms = DEADLOCK_STALL_MS;
+      if (argv[prog][10] == '=') {
+        char* end;
+        stall_ms = strtoul(argv[prog] + 11, &end, 0);
+        if (*end != '\0' || stall_ms == 0) {
+          fprintf(stderr, "Invalid stall time '%s'\n", argv[prog] + 11);
+          exit(EXIT_FAILURE);
+        }
+      }
+    } else if (strncmp(argv[prog], "--workers=", 10) == 0) {
+      char* end;
+      num_workers = strtoul(argv[prog] + 10, &end, 0);
+      if (*end != '\0' || num_workers == 0 || num_workers > MAX_WORKERS) {
+        fprintf(stderr, "Invalid number of workers '%s'\n", argv[prog] + 10);
+        exit(EXIT_FAILURE);
+      }
+    } else if (strcmp(argv[prog], "--profile") == 0
+               || strncmp(argv[prog], "--profile=", 10) == 0) {
+      profile_hz = PROFILE_HZ;
+      if (argv[prog][9] == '=') {
+        char* end;
+        profile_hz = strtoul(argv[prog] + 10, &end, 0);
+        if (*end != '\0' || profile_hz == 0 || profile_hz > MAX_PROFILE_HZ) {
+          fprintf(stderr, "Invalid sampling frequency '%s'\n", argv[prog] + 10);
+          exit(EXIT_FAILURE);
+        }
+      }
+    } else if (strcmp(argv[prog], "--coverage") == 0
+               || strncmp(argv[prog], "--coverage=", 11) == 0) {
+      coverage = stdout;
+      if (argv[prog][10] == '=') {
+        coverage = fopen(argv[prog] + 11, "we");
+        if (coverage == NULL) {
+          perror("Failed to open coverage file");
+          exit(EXIT_FAILURE);
+        }
+      }
+    } else if (strncmp(argv[prog], "--schedule=", 11) == 0) {
+      policy = schedule_policy::parse(argv[prog] + 11);
+      if (!policy) {
+        fprintf(stderr, "Unknown schedule '%s'\n", argv[prog] + 11);
+        exit(EXIT_FAILURE);
+      }
+    } else {
+      fprintf(stderr, "Unknown option '%s'\n", argv[prog]);
+      exit(EXIT_FAILURE);
+    }
+    prog++;
+  }
+  if (policy && !watch_specs.empty()) {
+    fprintf(stderr, "--schedule cannot be combined with --watch\n");
+    exit(EXIT_FAILURE);
+  }
+  if (!watch_specs.empty() && !race_specs.empty()) {
+    fprintf(stderr, "--watch cannot be combined with --race\n");
+    exit(EXIT_FAILURE);
+  }
+  if (profile_hz > 0 && (next_mode || skip_nodebug || batch || !watch_specs.empty() || lock_mode
+                         || policy || num_workers > 0)) {
+    fprintf(stderr, "--profile cannot be combined with other modes\n");
+    exit(EXIT_FAILURE);
+  }
+  if (coverage != NULL && (next_mode || skip_nodebug || batch || !watch_specs.empty() || lock_mode
+                           || policy || num_workers > 0 || profile_hz > 0)) {
+    fprintf(stderr, "--coverage cannot be combined with other modes\n");
+    exit(EXIT_FAILURE);
+  }
+  if (num_workers > 0 && (!batch || binary_path != NULL || !watch_specs.empty() || lock_mode)) {
+    fprintf(stderr, "--workers only applies to --trace, without --binary-trace, --watch, --locks, --deadlock or --race\n");
+    exit(EXIT_FAILURE);
+  }
+
   /* Parse command line arguments */
-  if(argc < 2) {
-    fprintf(stderr, "Usage: %s <program path> <program command inputs>\n", argv[0]);
+  if(argc - prog < 1) {
+    fprintf(stderr, "Usage: %s [--next] [--skip-nodebug] [--trace[=<file>]] [--binary-trace=<file>] [--workers=<N>] [--regs=getregs|peekuser|regset] [--watch=<variable|main:variable|address[:bytes]>]... [--locks] [--deadlock[=<ms>]] [--race=<variable|main:variable|address[:bytes]>]... [--schedule=rr[:N]|random:<seed>|pct:<seed>[:<depth>[:<steps>]]] [--profile[=<hz>]] [--coverage[=<file>]] <program path> <program command inputs>\n", argv[0]);
     exit(EXIT_FAILURE);
   }
 
+  // Batch traces go through a large buffer instead of a write per line
+  if (batch) {
+    setvbuf(out, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+  }
+
   // Process command line inputs to pass them to execv
-  char* inputs[argc];
-  inputs[0] = argv[1];
-  for(int i = 2; i < argc; i++) {
-    inputs[i-1] = argv[i];
+  int num_inputs = argc - prog;
+  char* inputs[num_inputs + 1];
+  for(int i = 0; i < num_inputs; i++) {
+    inputs[i] = argv[prog + i];
+  }
+  inputs[num_inputs] = NULL;
+
+  if (profile_hz > 0) {
+    return run_profile(inputs, profile_hz, out);
+  }
+  if (coverage != NULL) {
+    return run_coverage(inputs, coverage, out);
   }
-  inputs[argc-1] = NULL;
 
   /* a vector to store information and line-table for all files involved */
   vector<shared_obj> shared_objs;
+  debug_info_cache debug_infos;
 
   /* debuggee */
   pid_t child;
@@ -211,6 +759,11 @@ int main(int argc, char** argv)  {
 
     /* In the child program. Run the debuggee */
     ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+    // A schedule can only be replayed if the program takes the same paths,
+    //   and some of them depend on where the heap and libraries are mapped
+    if (policy) {
+      personality(ADDR_NO_RANDOMIZE);
+    }
     execv(inputs[0], inputs);
 
   } else {
@@ -229,63 +782,550 @@ int main(int argc, char** argv)  {
 
     /* Parse child's memory maps */
     /* Store info into shared_objs vector */
-    if (populate_shared_objs(child, shared_objs)) {
+    if (populate_shared_objs(child, shared_objs, debug_infos)) {
       perror("Failed to parse child's map file.");
       exit(EXIT_FAILURE);
     }
 
+    /* Build the files' tables on worker threads, while the child runs to
+       main. The libraries opened later are queued for the workers as they
+       are found. The tracer only waits for a file's tables when it needs
+       them. */
+    try {
+      debug_infos.preload(std::max(1u, std::thread::hardware_concurrency()));
+    } catch(std::system_error &e) {
+      // The tables are built on first use instead
+    }
+
+    /* Record stops in binary form, to be symbolized offline by trace_decoder */
+    std::unique_ptr<trace_writer> writer;
+    if (binary_path != NULL) {
+      try {
+        writer.reset(new trace_writer{binary_path, shared_objs});
+      } catch(std::invalid_argument &e) {
+        fprintf(stderr, "%s\n", e.what());
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    /* Owns every breakpoint inserted in the child */
+    std::unique_ptr<breakpoint_manager> breakpoints;
+    try {
+      breakpoints.reset(new breakpoint_manager{child});
+    } catch(std::runtime_error &e) {
+      fprintf(stderr, "%s\n", e.what());
+      exit(EXIT_FAILURE);
+    }
+
     /* Set breakpoint for child's main function. */
     // We assume the main executable is the first entry of the maps table
-    break_at_main(child, shared_objs[0]);
+    break_at_main(child, shared_objs[0], *breakpoints);
+
+    /* Index the objects by address range for the stepping loop */
+    object_index index;
+    index.build(shared_objs);
+
+    /* Symbolize and print --trace stops on worker threads, so that the
+       tracing loop only captures them */
+    std::unique_ptr<trace_pipeline> pipeline;
+    if (num_workers > 0) {
+      try {
+        pipeline.reset(new trace_pipeline{index, out, num_workers});
+      } catch(std::system_error &e) {
+        fprintf(stderr, "%s\n", e.what());
+        exit(EXIT_FAILURE);
+      }
+    }
 
-    /* A struct to store debuggee status */
-    struct user_regs_struct regs;
+    /* Registers of the stopped threads, fetched only when needed */
+    register_cache regs {strategy};
 
-    /* Advance to child's next instruction */
-    if (ptrace(PTRACE_SINGLESTEP, child, NULL, NULL) == -1) {
-      perror("Error in ptrace with PTRACE_SINGLESTEP");
+    /* Walks the call stacks for "where" and the deadlock reports */
+    stack_unwinder unwinder {index};
+
+    /* Add the libraries mapped on the way to main to the index, and follow
+       the ones loaded or unloaded later, e.g. by dlopen */
+    std::unique_ptr<library_tracker> libraries {new library_tracker{index, debug_infos, regs,
+                                                                    *breakpoints, writer.get()}};
+    if (!libraries->attach(child, shared_objs)) {
+      libraries.reset();
+    }
+
+    /* Program the debug registers for --watch or --race. Threads are armed
+       on their first stop, since new threads start without watchpoints.
+       --race needs to tell writes from reads, which takes a second register
+       per location. */
+    watchpoint_set watches {!race_specs.empty()};
+    for (auto spec : race_specs.empty() ? watch_specs : race_specs) {
+      intptr_t addr;
+      size_t size;
+      if (!resolve_watch(spec, shared_objs, child, regs, addr, size)) {
+        fprintf(stderr, "Cannot find a global variable, local variable of main or address '%s'\n", spec);
+        exit(EXIT_FAILURE);
+      }
+      if (!watches.add(spec, addr, size)) {
+        fprintf(stderr, "Not enough debug registers left to watch '%s'\n", spec);
+        exit(EXIT_FAILURE);
+      }
+    }
+    // The child runs before its next stop
+    regs.invalidate(child);
+    if (!watches.empty() && !watches.arm(child)) {
+      perror("Failed to set the debug registers");
+      exit(EXIT_FAILURE);
+    }
+
+    /* Break on the pthread functions for --locks. The libraries were mapped
+       on the way to main, so the maps file is read again. */
+    std::unique_ptr<lock_tracer> locks;
+    if (lock_mode) {
+      vector<shared_obj> loaded;
+      if (populate_shared_objs(child, loaded, debug_infos)) {
+        perror("Failed to parse child's map file.");
+        exit(EXIT_FAILURE);
+      }
+      locks.reset(new lock_tracer{regs, *breakpoints});
+      if (locks->attach(loaded) == 0) {
+        fprintf(stderr, "No pthread functions found in '%s'\n", inputs[0]);
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    /* Build a wait-for graph from the lock events for --deadlock */
+    std::unique_ptr<deadlock_detector> deadlocks;
+    if (stall_ms > 0) {
+      deadlocks.reset(new deadlock_detector{stall_ms});
+    }
+    vector<deadlock_link> links;
+    unordered_map<pid_t, vector<intptr_t>> stacks;
+    bool killed = false;
+
+    /* Order the accesses to the --race locations by the lock events */
+    std::unique_ptr<race_detector> races;
+    if (!race_specs.empty()) {
+      races.reset(new race_detector{watches.get_watchpoints().size()});
+    }
+    race_report race;
+
+    /* Every traced thread, and the queue of their events */
+    thread_table threads {!watches.empty() || locks ? step_mode::FREE
+                          : next_mode ? step_mode::LINE : step_mode::INSTRUCTION};
+    threads.add(child, thread_state::RUNNING);
+    std::vector<pid_t> paused; // Threads stopped while another steps over a breakpoint
+
+    /* Advances threads by instruction, or by source line in --next mode */
+    line_stepper stepper {child, threads, index, regs, *breakpoints, next_mode, skip_nodebug};
+
+    /* In --schedule mode, only the thread chosen by the scheduler runs */
+    std::unique_ptr<scheduler> sched;
+    if (policy) {
+      sched.reset(new scheduler{std::move(policy)});
+      sched->add(child);
+    }
+
+    // Resume the thread chosen by the scheduler, finishing its step if it
+    //   was interrupted. In lock mode the thread runs to its next pthread
+    //   call.
+    auto schedule_next = [&]() {
+      pid_t next;
+      while ((next = sched->next()) != 0) {
+        thread_info *t = threads.find(next);
+        if (t == nullptr) {
+          return;
+        }
+        t->state = thread_state::RUNNING;
+        if (t->mode != step_mode::FREE) {
+          if (t->mid_step) {
+            stepper.keep_going(next, 0);
+          } else {
+            stepper.resume(next);
+          }
+          t->mid_step = true;
+          return;
+        }
+        if (locks->resume(next, 0)) {
+          return;
+        }
+        // The thread exited while stepping over a breakpoint
+        regs.thread_exited(next);
+        sched->remove(next);
+        threads.erase(next);
+      }
+    };
+    unordered_map<uintptr_t, pid_t> owners; // Holder of each mutex, for --schedule in lock mode
+
+    /* Advance to child's next instruction, or run until a watched access or
+       a pthread call */
+    if (sched) {
+      schedule_next();
+    } else if (ptrace(watches.empty() && !locks ? PTRACE_SINGLESTEP : PTRACE_CONT, child,
+                      NULL, NULL) == -1) {
+      perror("Error in ptrace");
       exit(EXIT_FAILURE);
     }
 
     // Begin tracing child's execution
-    printf("Executing '%s'\n\n", inputs[0]);
+    fprintf(out, "Executing '%s'\n\n", inputs[0]);
 
-    while (true)  {
-      // Wait for any of the child's threads to change status
-      pid_t current = waitpid(-1, &status, 0);
+    /* Statistics reported at the end of a --trace run */
+    unsigned long num_stops = 0;
+    unsigned long num_lines = 0;
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
 
-      // Check whether all threads haves exited
-      if (current == -1){
-        break;
+    // Wait for any of the child's threads to change status, until all
+    //   threads have exited
+    thread_event event;
+    int waited;
+    int timeout_ms = sched ? (locks ? SCHEDULE_LOCK_TIMEOUT_MS : SCHEDULE_TIMEOUT_MS)
+                     : deadlocks ? std::max(stall_ms / 2, 1UL) : -1;
+    while ((waited = threads.next_event(event, timeout_ms)) >= 0)  {
+      // Threads waiting too long are reported whether or not others still
+      //   run. Once no thread has run for a while, check whether they all
+      //   wait for each other, and end the program if so.
+      if (deadlocks && !killed) {
+        if (deadlocks->find_stalled(links)) {
+          char title[64];
+          snprintf(title, sizeof(title), "Stalled threads, waiting for over %lu ms:", stall_ms);
+          print_deadlock(out, title, links, stacks, index);
+        }
+        if (waited == 0 && deadlocks->all_blocked(threads.size(), links)) {
+          print_deadlock(out, "Deadlock: every thread is blocked. Killing the program.", links, stacks, index);
+          kill(child, SIGKILL);
+          killed = true;
+        }
+      }
+      if (waited == 0 && !sched) {
+        continue;
+      }
+
+      // The scheduled thread did not stop in time: it is probably blocked,
+      //   e.g. waiting for a lock held by a stopped thread. Interrupt it.
+      if (waited == 0) {
+        thread_info *t = threads.find(sched->get_running());
+        if (t == nullptr) {
+          schedule_next();
+        } else if (!t->interrupted) {
+          syscall(SYS_tgkill, child, t->tid, SIGSTOP);
+          t->interrupted = true;
+        } else if (syscall(SYS_tgkill, child, t->tid, 0) == -1) {
+          // The thread's exit was consumed while stepping over a breakpoint
+          stepper.thread_exited(t->tid);
+          regs.thread_exited(t->tid);
+          if (locks) {
+            locks->thread_exited(t->tid);
+          }
+          sched->remove(t->tid);
+          threads.erase(t->tid);
+          schedule_next();
+        }
+        continue;
+      }
+      pid_t current = event.tid;
+
+      // Forget threads that exited
+      if (event.type == thread_event::EXITED) {
+        stepper.thread_exited(current);
+        regs.thread_exited(current);
+        if (locks) {
+          locks->thread_exited(current);
+        }
+        if (deadlocks && deadlocks->thread_exited(current, links) && !killed) {
+          print_deadlock(out, "Deadlock: a thread exited without unlocking a mutex others wait for:",
+                         links, stacks, index);
+        }
+        if (writer) {
+          writer->thread_exit(current);
+        }
+        if (pipeline) {
+          pipeline->thread_exit(current);
+        }
+        if (sched) {
+          sched->remove(current);
+          if (sched->get_running() == 0) {
+            schedule_next();
+          }
+        }
+        continue;
       }
 
       /* Note: We skip error checking of ptrace calls, because any error will be
            caught by waitpid in the next loop iteration. */
 
-      // Get current thread's register contents
-      ptrace(PTRACE_GETREGS, current, NULL, &regs);
-
-      /*For each instruction call, determine which source file it comes from
-      * by walking through the shared_obj vector
-      */
-      for (auto obj : shared_objs) {
-        /* if a file is found, check line table for that instruction */
-        if (obj.contains(regs.rip)) {
-          printf("Thread ID (PID): %d | Instruction address: %llx\n", current, regs.rip);
-          bool found = print_line_info(obj, regs.rip);
+      thread_info &thread = *threads.find(current);
+
+      // The dynamic linker changed its list of objects. Workers stop using
+      //   the index before it changes. A library loaded where an unloaded
+      //   one was must not be given the cached lines of the old one.
+      bool at_hook = libraries && event.type == thread_event::TRAP
+                     && libraries->handle_stop(current);
+      if (at_hook) {
+        if (pipeline) {
+          pipeline->drain();
+        }
+        if (libraries->update(current)) {
+          threads.forget_lines();
+          if (pipeline) {
+            pipeline->forget_lines();
+          }
+        }
+      }
+
+      // New threads wait for the scheduler to choose them
+      if (sched && event.type == thread_event::NEW_THREAD) {
+        sched->add(current);
+        continue;
+      }
+
+      // The scheduled thread was interrupted because it was blocked
+      if (sched && event.type == thread_event::SIGNAL && event.sig == SIGSTOP
+          && thread.interrupted) {
+        thread.interrupted = false;
+        sched->park(current, true);
+        schedule_next();
+        continue;
+      }
+
+      // The SIGSTOP that paused the thread while another one stepped over a
+      //   breakpoint, reported after the thread's previous event
+      if (event.type == thread_event::SIGNAL && event.sig == SIGSTOP && thread.interrupted) {
+        thread.interrupted = false;
+        event.sig = 0;
+      }
+      thread.state = thread_state::RUNNING;
+
+      // New threads do not inherit the debug registers of their parent
+      if (event.type == thread_event::NEW_THREAD && !watches.empty()) {
+        watches.arm(current);
+      }
+
+      // Ptrace events and signals are not steps: resume the thread as it
+      //   was going, delivering the signal
+      if (event.type == thread_event::CLONED || event.type == thread_event::EVENT
+          || event.type == thread_event::SIGNAL) {
+        if (deadlocks && event.type == thread_event::CLONED) {
+          deadlocks->thread_created(current, event.new_tid);
+        }
+        if (races && event.type == thread_event::CLONED) {
+          races->thread_created(current, event.new_tid);
+        }
+        if (thread.mode == step_mode::FREE) {
+          regs.invalidate(current);
+          ptrace(PTRACE_CONT, current, NULL, event.sig);
+        } else {
+          stepper.keep_going(current, event.sig);
+        }
+        continue;
+      }
+
+      // In watch and lock modes threads run at full speed, and only stop
+      //   right after accessing a watched location, or at a pthread call
+      if (thread.mode == step_mode::FREE) {
+        bool write = false;
+        int watch = event.type == thread_event::TRAP ? watches.hit(current, write) : -1;
+        lock_event lock;
+        bool traced = false;
+        intptr_t line_ip = 0;
+        if (watch != -1 && races) {
+          // --race only reports the races, not every access
+          num_stops++;
+          if (races->access(current, watch, write, regs.get_ip(current), race)) {
+            print_race(out, race, watches.get_watchpoints()[watch], index);
+          }
+        } else if (watch != -1) {
+          const watchpoint &wp = watches.get_watchpoints()[watch];
+          intptr_t rip = regs.get_ip(current);
+          uint64_t value = 0;
+          read_memory(current, wp.addr, &value, std::min(wp.size, sizeof(value)));
+          fprintf(out, "Thread ID (PID): %d | Accessed %s at %lx (value %#lx) | Instruction address: %lx\n",
+                  current, wp.label.c_str(), wp.addr, (unsigned long)value, rip);
+          thread.last_ip = line_ip = rip;
+        } else if (locks && event.type == thread_event::TRAP && locks->handle_stop(current, lock)) {
+          traced = true;
+          num_stops++;
+          if (races) {
+            races->handle_event(lock);
+          }
+          // --deadlock and --race only report what they detect, not every event
+          if (deadlocks) {
+            // The stack of a blocking call is kept until the thread's next
+            //   one, in case the wait is reported
+            if (lock.type == lock_event::LOCK || lock.type == lock_event::JOIN) {
+              unwinder.unwind(current, regs, stacks[current], DEADLOCK_FRAMES);
+            }
+            if (deadlocks->handle_event(lock, links)) {
+              print_deadlock(out, links.back().holder_exited
+                             ? "Deadlock: a thread exited without unlocking a mutex others wait for:"
+                             : "Deadlock: threads wait for each other:", links, stacks, index);
+            }
+          } else if (!races) {
+            fprintf(out, "Thread ID (PID): %d | %s %#lx | Call site: %lx\n",
+                    current, lock_tracer::get_name(lock.type), (unsigned long)lock.object,
+                    lock.call_site);
+            // The call instruction ends right before the return address
+            line_ip = lock.call_site - 1;
+          }
+        }
+
+        if (line_ip != 0) {
+          shared_obj *obj = index.find(line_ip, thread.obj_hint);
+          bool found = obj != nullptr && print_thread_line(out, *obj, thread, line_ip);
+          if (watch != -1) {
+            num_stops++;
+          }
           if (found) {
-            // Stop execution when next line number is found
-            getchar();
+            num_lines++;
+          }
+          if (!batch) {
+            wait_for_user(out, current, regs, unwinder, index);
+          }
+        }
+
+        // With --schedule, the calls that may wait for another thread are the
+        //   schedule points. A thread about to lock a mutex held by a stopped
+        //   thread is not chosen again until the mutex is unlocked; other
+        //   waits are found by the timeout.
+        if (sched && traced) {
+          if (lock.type == lock_event::ACQUIRED) {
+            owners[lock.object] = current;
+          } else if (lock.type == lock_event::UNLOCK) {
+            // The thread keeps running until its next call, so the mutex is
+            //   free by the time a waiting thread is chosen
+            owners.erase(lock.object);
+            sched->release(lock.object);
+          }
+          if (lock.type == lock_event::LOCK || lock.type == lock_event::CREATE
+              || lock.type == lock_event::JOIN) {
+            thread.state = thread_state::STOPPED;
+            auto owner = owners.find(lock.object);
+            if (lock.type == lock_event::LOCK && owner != owners.end() && owner->second != current) {
+              sched->park_waiting(current, lock.object);
+            } else {
+              sched->park(current, false);
+            }
+            schedule_next();
+            continue;
+          }
+        }
+
+        // Other threads would run past a breakpoint while it is lifted to
+        //   step over it, so they are stopped meanwhile
+        bool at_breakpoint = at_hook || (locks && locks->at_breakpoint(current));
+        if (at_breakpoint) {
+          threads.pause_others(child, current, paused);
+        }
+        // A SIGTRAP that is neither a watch hit nor one of the breakpoints
+        //   is the program's own, e.g. from raise(SIGTRAP)
+        int sig = event.type == thread_event::TRAP && watch == -1 && !at_breakpoint ? SIGTRAP : 0;
+        bool resumed = true;
+        if (!locks) {
+          // Run the instruction under the hook's breakpoint first
+          if (at_hook) {
+            regs.set_ip(current, libraries->get_hook());
+            resumed = breakpoints->step_over(current, libraries->get_hook());
+          }
+          if (resumed) {
+            regs.invalidate(current);
+            ptrace(PTRACE_CONT, current, NULL, sig);
+          }
+        } else {
+          resumed = locks->resume(current, sig);
+        }
+        threads.resume_paused(paused);
+        paused.clear();
+        if (!resumed) {
+          // The thread exited while stepping over a breakpoint
+          regs.thread_exited(current);
+          threads.erase(current);
+          if (deadlocks && deadlocks->thread_exited(current, links) && !killed) {
+            print_deadlock(out, "Deadlock: a thread exited without unlocking a mutex others wait for:",
+                           links, stacks, index);
           }
-          break;
         }
+        continue;
       }
 
-      // Advance the current thread a single instruction
-      ptrace(PTRACE_SINGLESTEP, current, NULL, NULL);
+      // Skip stops that are internal to the stepper, e.g. reaching another
+      //   thread's breakpoint, or an instruction of the line being stepped
+      if (!stepper.handle_stop(current)) {
+        continue;
+      }
+      intptr_t rip = regs.get_ip(current);
+      thread.last_ip = rip;
+
+      // Binary traces are symbolized offline, so only record the address
+      shared_obj *obj = nullptr;
+      if (writer) {
+        writer->record(current, rip);
+        num_stops++;
+      } else if (pipeline) {
+        pipeline->record(current, rip);
+        num_stops++;
+      } else {
+        /* For each instruction call, determine which source file it comes from
+        * by looking up the object index
+        */
+        obj = index.find(rip, thread.obj_hint);
+      }
+
+      /* if a file is found, check line table for that instruction */
+      if (obj != nullptr) {
+        fprintf(out, "Thread ID (PID): %d | Instruction address: %lx\n", current, rip);
+        bool found = print_thread_line(out, *obj, thread, rip);
+        num_stops++;
+        if (found) {
+          num_lines++;
+          // Stop execution when next line number is found
+          if (!batch) {
+            wait_for_user(out, current, regs, unwinder, index);
+          }
+        }
+      }
+
+      // Advance the current thread a single instruction, or to its next line,
+      //   or let the scheduler choose another thread
+      if (sched) {
+        thread.mid_step = false;
+        thread.state = thread_state::STOPPED;
+        sched->park(current, false);
+        schedule_next();
+      } else {
+        stepper.resume(current);
+      }
+    }
+
+    // The trace is complete once the workers printed every stop
+    if (pipeline) {
+      pipeline->finish();
+      num_lines = pipeline->get_lines();
+    }
+
+    if (batch) {
+      struct timespec end_time;
+      clock_gettime(CLOCK_MONOTONIC, &end_time);
+      double seconds = (end_time.tv_sec - start_time.tv_sec)
+        + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+      fprintf(stderr, "Traced %lu %s (%lu with line information) in %.3f s, %.0f stops/s\n",
+              num_stops, races ? "events and accesses" : locks ? "events" : next_mode ? "stops" : watches.empty() ? "instructions" : "accesses", num_lines, seconds,
+              seconds > 0 ? num_stops / seconds : 0.0);
+      fprintf(stderr, "Register access: %lu ptrace calls (%.2f per stop)\n",
+              (unsigned long)regs.get_calls(),
+              num_stops > 0 ? (double)regs.get_calls() / num_stops : 0.0);
+      if (sched) {
+        fprintf(stderr, "Schedule points: %lu (%.0f/s)\n", (unsigned long)sched->get_points(),
+                seconds > 0 ? sched->get_points() / seconds : 0.0);
+      }
+      if (writer) {
+        fprintf(stderr, "Wrote %lu bytes of binary trace (%.2f bytes/stop)\n",
+                (unsigned long)writer->bytes_written(),
+                num_stops > 0 ? (double)writer->bytes_written() / num_stops : 0.0);
+      }
     }
   }
 
-  printf("\nProgram '%s' terminated.\n", inputs[0]);
+  fprintf(out, "\nProgram '%s' terminated.\n", inputs[0]);
+  if (out != stdout) {
+    fclose(out);
+  }
   return 0;
 }
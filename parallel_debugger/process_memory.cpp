@@ -0,0 +1,24 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "process_memory.hh"
+
+/**
+* read a block of the traced process' memory in a single system call
+* @param  pid  a thread of the traced process
+* @param  addr the address to read from
+* @param  buf  the buffer to read into
+* @param  len  the number of bytes to read
+* @return      true if all len bytes were read, false otherwise
+*/
+bool read_memory(pid_t pid, intptr_t addr, void* buf, size_t len) {
+  struct iovec local = {buf, len};
+  struct iovec remote = {reinterpret_cast<void*>(addr), len};
+  return process_vm_readv(pid, &local, 1, &remote, 1, 0) == (ssize_t)len;
+}
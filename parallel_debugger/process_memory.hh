@@ -0,0 +1,18 @@
+#ifndef _PROCESS_MEMORY_HH_
+#define _PROCESS_MEMORY_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+* read a block of the traced process' memory in a single system call
+* @param  pid  a thread of the traced process
+* @param  addr the address to read from
+* @param  buf  the buffer to read into
+* @param  len  the number of bytes to read
+* @return      true if all len bytes were read, false otherwise
+*/
+bool read_memory(pid_t pid, intptr_t addr, void* buf, size_t len);
+
+#endif /* _PROCESS_MEMORY_HH_ */
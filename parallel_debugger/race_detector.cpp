@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <algorithm>
+
+#include "race_detector.hh"
+
+// An epoch packs a thread number, plus one so that 0 means no access, and
+//   that thread's clock
+#define MAKE_EPOCH(thread, clock) (((uint64_t)(thread) + 1) << 32 | (clock))
+#define EPOCH_THREAD(e)           ((uint32_t)((e) >> 32) - 1)
+#define EPOCH_CLOCK(e)            ((uint32_t)(e))
+
+/**
+* join a vector clock into another, keeping the later time of each thread
+* @param into the clock that is advanced
+* @param from the clock joined into it
+*/
+static void join_clocks(std::vector<uint32_t> &into, const std::vector<uint32_t> &from) {
+  if (into.size() < from.size()) {
+    into.resize(from.size(), 0);
+  }
+  for (size_t i = 0; i < from.size(); i++) {
+    into[i] = std::max(into[i], from[i]);
+  }
+}
+
+/**
+* construct a new race detector
+* @param locations the number of watched locations
+*/
+race_detector::race_detector(size_t locations)
+: locations(locations, location_state{0, 0, 0, 0, false, {}, {}})
+{}
+
+/**
+* order a new thread after everything its parent did so far
+* @param parent the thread that created the new thread
+* @param child  the new thread
+*/
+void race_detector::thread_created(pid_t parent, pid_t child) {
+  uint32_t p = get_thread(parent);
+  uint32_t c = get_thread(child);
+  join_clocks(clocks[c], clocks[p]);
+  clocks[p][p]++;
+  last_created[parent] = child;
+}
+
+/**
+* update the vector clocks with a synchronization event
+* @param event the event
+*/
+void race_detector::handle_event(const lock_event &event) {
+  uint32_t t = get_thread(event.tid);
+  switch (event.type) {
+    case lock_event::ACQUIRED: {
+      auto it = locks.find(event.object);
+      if (it != locks.end()) {
+        join_clocks(clocks[t], it->second);
+      }
+      break;
+    }
+    case lock_event::UNLOCK:
+      locks[event.object] = clocks[t];
+      clocks[t][t]++;
+      break;
+    case lock_event::CREATED: {
+      auto it = last_created.find(event.tid);
+      if (it != last_created.end()) {
+        handles[event.object] = it->second;
+        last_created.erase(it);
+      }
+      break;
+    }
+    case lock_event::JOINED: {
+      auto it = handles.find(event.object);
+      if (it != handles.end()) {
+        uint32_t u = get_thread(it->second);
+        join_clocks(clocks[t], clocks[u]);
+        handles.erase(it);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+/**
+* check an access to a watched location
+* @param  tid      the accessing thread
+* @param  location the index of the location
+* @param  write    whether the access is a write
+* @param  ip       the instruction pointer after the access
+* @param  report   set to the race, if one is found
+* @return          true if the access races with an earlier one that was
+*                  not reported from the same pair of instructions yet
+*/
+bool race_detector::access(pid_t tid, size_t location, bool write, intptr_t ip,
+                           race_report &report) {
+  uint32_t t = get_thread(tid);
+  vector_clock &clock = clocks[t];
+  epoch now = MAKE_EPOCH(t, clock[t]);
+  location_state &x = locations[location];
+
+  report.location = location;
+  report.tid = tid;
+  report.write = write;
+  report.ip = ip;
+  bool race = false;
+
+  // The earlier access that races, if any: the last write first
+  auto found = [&](epoch e, bool prev_write, intptr_t prev_ip) {
+    race = true;
+    report.prev_tid = tids[EPOCH_THREAD(e)];
+    report.prev_write = prev_write;
+    report.prev_ip = prev_ip;
+  };
+
+  if (!write) {
+    // Same epoch: nothing new to check
+    if (!x.shared && x.read == now) {
+      return false;
+    }
+    if (!happened_before(x.write, t)) {
+      found(x.write, true, x.write_ip);
+    }
+
+    if (x.shared) {
+      if (x.reads.size() <= t) {
+        x.reads.resize(t + 1, 0);
+        x.read_ips.resize(t + 1, 0);
+      }
+      x.reads[t] = clock[t];
+      x.read_ips[t] = ip;
+    } else if (happened_before(x.read, t)) {
+      x.read = now;
+      x.read_ip = ip;
+    } else {
+      // Concurrent reads: keep the last read of every thread
+      uint32_t u = EPOCH_THREAD(x.read);
+      x.shared = true;
+      x.reads.assign(std::max(u, t) + 1, 0);
+      x.read_ips.assign(std::max(u, t) + 1, 0);
+      x.reads[u] = EPOCH_CLOCK(x.read);
+      x.read_ips[u] = x.read_ip;
+      x.reads[t] = clock[t];
+      x.read_ips[t] = ip;
+      x.read = 0;
+    }
+  } else {
+    if (x.write == now) {
+      return false;
+    }
+    if (!happened_before(x.write, t)) {
+      found(x.write, true, x.write_ip);
+    } else if (!x.shared && !happened_before(x.read, t)) {
+      found(x.read, false, x.read_ip);
+    } else if (x.shared) {
+      for (uint32_t u = 0; u < x.reads.size(); u++) {
+        if (x.reads[u] > (u < clock.size() ? clock[u] : 0)) {
+          found(MAKE_EPOCH(u, x.reads[u]), false, x.read_ips[u]);
+          break;
+        }
+      }
+    }
+
+    // Every read is now ordered before this write, or was reported
+    if (x.shared) {
+      x.shared = false;
+      x.reads.clear();
+      x.read_ips.clear();
+      x.read = 0;
+    }
+    x.write = now;
+    x.write_ip = ip;
+  }
+  return race && report_once(report);
+}
+
+/**
+* get the number of a thread, numbering it on first use
+* @param  tid the thread
+* @return     the thread's number, an index into clocks
+*/
+uint32_t race_detector::get_thread(pid_t tid) {
+  auto it = numbers.find(tid);
+  if (it != numbers.end()) {
+    return it->second;
+  }
+  uint32_t number = tids.size();
+  numbers[tid] = number;
+  tids.push_back(tid);
+  clocks.push_back(vector_clock(number + 1, 0));
+  clocks[number][number] = 1;
+  return number;
+}
+
+/**
+* check whether an epoch happened before a thread's current time
+* @param  e      the epoch
+* @param  thread the thread's number
+* @return        true if the epoch is ordered before the thread's time
+*/
+bool race_detector::happened_before(epoch e, uint32_t thread) {
+  if (e == 0) {
+    return true;
+  }
+  const vector_clock &clock = clocks[thread];
+  uint32_t u = EPOCH_THREAD(e);
+  return u < clock.size() && EPOCH_CLOCK(e) <= clock[u];
+}
+
+/**
+* check whether a race is the first one between its pair of instructions
+* @param  report the race
+* @return        true if the pair is new, false otherwise
+*/
+bool race_detector::report_once(const race_report &report) {
+  auto pair = std::make_pair(std::min(report.ip, report.prev_ip),
+                             std::max(report.ip, report.prev_ip));
+  return reported.insert(pair).second;
+}
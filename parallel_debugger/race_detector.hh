@@ -0,0 +1,115 @@
+#ifndef _RACE_DETECTOR_HH_
+#define _RACE_DETECTOR_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "lock_tracer.hh"
+
+// Two accesses to a location that are not ordered by synchronization
+struct race_report {
+  size_t location;     // Index of the location
+  pid_t tid;           // Thread of the later access
+  bool write;          // Whether the later access is a write
+  intptr_t ip;         // Instruction pointer after the later access
+  pid_t prev_tid;      // Thread of the earlier access
+  bool prev_write;     // Whether the earlier access is a write
+  intptr_t prev_ip;    // Instruction pointer after the earlier access
+};
+
+/**
+ * Happens-before race detection with the FastTrack algorithm. Threads and
+ *   mutexes get vector clocks, which synchronization events join. Each
+ *   location only keeps the epoch (thread and clock) of its last write and
+ *   of its last read, and switches to a vector clock of reads only while
+ *   concurrent reads share it, so memory stays bounded on long runs.
+ */
+class race_detector {
+public:
+
+  /**
+  * construct a new race detector
+  * @param locations the number of watched locations
+  */
+  race_detector(size_t locations);
+
+  /**
+  * order a new thread after everything its parent did so far
+  * @param parent the thread that created the new thread
+  * @param child  the new thread
+  */
+  void thread_created(pid_t parent, pid_t child);
+
+  /**
+  * update the vector clocks with a synchronization event
+  * @param event the event
+  */
+  void handle_event(const lock_event &event);
+
+  /**
+  * check an access to a watched location
+  * @param  tid      the accessing thread
+  * @param  location the index of the location
+  * @param  write    whether the access is a write
+  * @param  ip       the instruction pointer after the access
+  * @param  report   set to the race, if one is found
+  * @return          true if the access races with an earlier one that was
+  *                  not reported from the same pair of instructions yet
+  */
+  bool access(pid_t tid, size_t location, bool write, intptr_t ip, race_report &report);
+
+private:
+  // A thread number and a clock value, packed as in FastTrack
+  typedef uint64_t epoch;
+  typedef std::vector<uint32_t> vector_clock;
+
+  // The last accesses to a location
+  struct location_state {
+    epoch write;                   // Epoch of the last write, 0 if none
+    intptr_t write_ip;             // Instruction of the last write
+    epoch read;                    // Epoch of the last read, unless shared
+    intptr_t read_ip;              // Instruction of the last read
+    bool shared;                   // Whether concurrent reads use reads
+    vector_clock reads;            // Clock of each thread's last read
+    std::vector<intptr_t> read_ips; // Instruction of each thread's last read
+  };
+
+  /**
+  * get the number of a thread, numbering it on first use
+  * @param  tid the thread
+  * @return     the thread's number, an index into clocks
+  */
+  uint32_t get_thread(pid_t tid);
+
+  /**
+  * check whether an epoch happened before a thread's current time
+  * @param  e      the epoch
+  * @param  thread the thread's number
+  * @return        true if the epoch is ordered before the thread's time
+  */
+  bool happened_before(epoch e, uint32_t thread);
+
+  /**
+  * check whether a race is the first one between its pair of instructions
+  * @param  report the race
+  * @return        true if the pair is new, false otherwise
+  */
+  bool report_once(const race_report &report);
+
+  std::unordered_map<pid_t, uint32_t> numbers;       // Number of each thread
+  std::vector<pid_t> tids;                           // Thread of each number
+  std::vector<vector_clock> clocks;                  // Clock of each thread
+  std::unordered_map<uintptr_t, vector_clock> locks; // Clock of each released mutex
+  std::unordered_map<uintptr_t, pid_t> handles;      // Thread of each pthread_t
+  std::unordered_map<pid_t, pid_t> last_created;     // Last thread created by each thread
+  std::vector<location_state> locations;             // State of each location
+  std::set<std::pair<intptr_t, intptr_t>> reported;  // Instruction pairs reported
+};
+
+#endif /* _RACE_DETECTOR_HH_ */
@@ -0,0 +1,142 @@
+#include <elf.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+
+#include "register_cache.hh"
+
+/**
+* get the instruction pointer of a stopped thread
+* @param  tid the stopped thread
+* @return     the thread's instruction pointer
+*/
+intptr_t register_cache::get_ip(pid_t tid) {
+  thread_regs &cache = threads[tid];
+  if (!cache.ip) {
+    cache.regs.rip = fetch(tid, cache, offsetof(struct user_regs_struct, rip));
+    cache.ip = true;
+  }
+  return cache.regs.rip;
+}
+
+/**
+* get the stack pointer of a stopped thread
+* @param  tid the stopped thread
+* @return     the thread's stack pointer
+*/
+intptr_t register_cache::get_sp(pid_t tid) {
+  thread_regs &cache = threads[tid];
+  if (!cache.sp) {
+    cache.regs.rsp = fetch(tid, cache, offsetof(struct user_regs_struct, rsp));
+    cache.sp = true;
+  }
+  return cache.regs.rsp;
+}
+
+/**
+* get the frame pointer (rbp) of a stopped thread
+* @param  tid the stopped thread
+* @return     the thread's frame pointer
+*/
+intptr_t register_cache::get_fp(pid_t tid) {
+  // Only read to unwind stacks, so it is not cached on its own
+  return fetch(tid, threads[tid], offsetof(struct user_regs_struct, rbp));
+}
+
+/**
+* get an integer argument of a stopped thread that is at the entry of a
+*   function, following the System V calling convention
+* @param  tid the stopped thread
+* @param  n   the index of the argument, from 0 to 5
+* @return     the argument's value
+*/
+unsigned long register_cache::get_arg(pid_t tid, unsigned n) {
+  static const size_t offsets[] = {
+    offsetof(struct user_regs_struct, rdi), offsetof(struct user_regs_struct, rsi),
+    offsetof(struct user_regs_struct, rdx), offsetof(struct user_regs_struct, rcx),
+    offsetof(struct user_regs_struct, r8), offsetof(struct user_regs_struct, r9)
+  };
+  // Arguments are only read at a few stops, so they are not cached one by one
+  return fetch(tid, threads[tid], offsets[n]);
+}
+
+/**
+* move the instruction pointer of a stopped thread
+* @param tid the stopped thread
+* @param ip  the new instruction pointer
+*/
+void register_cache::set_ip(pid_t tid, intptr_t ip) {
+  // A single POKEUSER is enough whatever the strategy
+  ptrace(PTRACE_POKEUSER, tid, offsetof(struct user, regs) + offsetof(struct user_regs_struct, rip),
+         ip);
+  calls++;
+
+  thread_regs &cache = threads[tid];
+  cache.regs.rip = ip;
+  cache.ip = true;
+}
+
+/**
+* forget the registers of a thread that is about to be resumed
+* @param tid the thread
+*/
+void register_cache::invalidate(pid_t tid) {
+  // Keep the entry, so its buffer is reused at the thread's next stop
+  auto it = threads.find(tid);
+  if (it != threads.end()) {
+    it->second.all = it->second.ip = it->second.sp = false;
+  }
+}
+
+/**
+* parse the name of a strategy
+* @param  name     "getregs", "peekuser" or "regset"
+* @param  strategy set to the named strategy
+* @return          true if the name is known, false otherwise
+*/
+bool register_cache::parse_strategy(const char* name, reg_strategy &strategy) {
+  if (strcmp(name, "getregs") == 0) {
+    strategy = reg_strategy::GETREGS;
+  } else if (strcmp(name, "peekuser") == 0) {
+    strategy = reg_strategy::PEEKUSER;
+  } else if (strcmp(name, "regset") == 0) {
+    strategy = reg_strategy::REGSET;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+* fetch a single register of a stopped thread
+* @param  tid    the stopped thread
+* @param  cache  the thread's cached registers
+* @param  offset the offset of the register in struct user_regs_struct
+* @return        the register's value
+*/
+unsigned long long register_cache::fetch(pid_t tid, thread_regs &cache, size_t offset) {
+  if (strategy == reg_strategy::PEEKUSER) {
+    calls++;
+    return ptrace(PTRACE_PEEKUSER, tid, offsetof(struct user, regs) + offset, NULL);
+  }
+
+  // The other strategies fetch every register at once
+  if (!cache.all) {
+    if (strategy == reg_strategy::GETREGS) {
+      ptrace(PTRACE_GETREGS, tid, NULL, &cache.regs);
+    } else {
+      struct iovec iov = {&cache.regs, sizeof(cache.regs)};
+      ptrace(PTRACE_GETREGSET, tid, NT_PRSTATUS, &iov);
+    }
+    calls++;
+    cache.all = cache.ip = cache.sp = true;
+  }
+  unsigned long long value;
+  memcpy(&value, reinterpret_cast<char*>(&cache.regs) + offset, sizeof(value));
+  return value;
+}
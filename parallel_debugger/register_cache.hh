@@ -0,0 +1,120 @@
+#ifndef _REGISTER_CACHE_HH_
+#define _REGISTER_CACHE_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/user.h>
+
+#include <unordered_map>
+
+// How registers are fetched from a stopped thread
+enum class reg_strategy {
+  GETREGS,  // PTRACE_GETREGS, the whole register set
+  PEEKUSER, // PTRACE_PEEKUSER, one register per call
+  REGSET    // PTRACE_GETREGSET, the whole register set into a reused buffer
+};
+
+/**
+ * Registers of stopped threads. Each register is fetched at most once per
+ *   stop: the cached values of a thread must be invalidated whenever the
+ *   thread is resumed. Counts the ptrace calls used, so the strategies can be
+ *   compared.
+ */
+class register_cache {
+public:
+
+  /**
+  * construct a new register cache
+  * @param strategy how registers are fetched
+  */
+  register_cache(reg_strategy strategy)
+  : strategy{strategy}, calls{0}
+  {}
+
+  /**
+  * get the instruction pointer of a stopped thread
+  * @param  tid the stopped thread
+  * @return     the thread's instruction pointer
+  */
+  intptr_t get_ip(pid_t tid);
+
+  /**
+  * get the stack pointer of a stopped thread
+  * @param  tid the stopped thread
+  * @return     the thread's stack pointer
+  */
+  intptr_t get_sp(pid_t tid);
+
+  /**
+  * get the frame pointer (rbp) of a stopped thread
+  * @param  tid the stopped thread
+  * @return     the thread's frame pointer
+  */
+  intptr_t get_fp(pid_t tid);
+
+  /**
+  * get an integer argument of a stopped thread that is at the entry of a
+  *   function, following the System V calling convention
+  * @param  tid the stopped thread
+  * @param  n   the index of the argument, from 0 to 5
+  * @return     the argument's value
+  */
+  unsigned long get_arg(pid_t tid, unsigned n);
+
+  /**
+  * move the instruction pointer of a stopped thread
+  * @param tid the stopped thread
+  * @param ip  the new instruction pointer
+  */
+  void set_ip(pid_t tid, intptr_t ip);
+
+  /**
+  * forget the registers of a thread that is about to be resumed
+  * @param tid the thread
+  */
+  void invalidate(pid_t tid);
+
+  /**
+  * forget a thread that exited
+  * @param tid the exited thread
+  */
+  void thread_exited(pid_t tid) { threads.erase(tid); }
+
+  /**
+  * @return the number of ptrace calls used to access registers so far
+  */
+  auto get_calls() const -> uint64_t { return calls; }
+
+  /**
+  * parse the name of a strategy
+  * @param  name     "getregs", "peekuser" or "regset"
+  * @param  strategy set to the named strategy
+  * @return          true if the name is known, false otherwise
+  */
+  static bool parse_strategy(const char* name, reg_strategy &strategy);
+
+private:
+  // Registers fetched from a thread since it last stopped
+  struct thread_regs {
+    struct user_regs_struct regs; // Register values, also the GETREGSET buffer
+    bool all;                     // Whether all of regs is valid
+    bool ip;                      // Whether regs.rip is valid
+    bool sp;                      // Whether regs.rsp is valid
+  };
+
+  /**
+  * fetch a single register of a stopped thread
+  * @param  tid    the stopped thread
+  * @param  cache  the thread's cached registers
+  * @param  offset the offset of the register in struct user_regs_struct
+  * @return        the register's value
+  */
+  unsigned long long fetch(pid_t tid, thread_regs &cache, size_t offset);
+
+  reg_strategy strategy;                          // How registers are fetched
+  uint64_t calls;                                 // ptrace calls used so far
+  std::unordered_map<pid_t, thread_regs> threads; // Registers of each thread
+};
+
+#endif /* _REGISTER_CACHE_HH_ */
@@ -0,0 +1,282 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "sampling_profiler.hh"
+
+// Functions and lines listed for all threads
+#define PROFILE_TOP 10
+
+// Functions and lines listed for each thread
+#define PROFILE_THREAD_TOP 5
+
+// Where a sampled address is in the source
+struct sample_location {
+  std::string function; // Function and object, as printed
+  std::string line;     // File and line, as printed
+};
+
+/**
+* compute the time from one instant to another
+* @param  from the earlier instant
+* @param  to   the later instant
+* @return      the elapsed time, in nanoseconds
+*/
+static long long elapsed_ns(const struct timespec &from, const struct timespec &to) {
+  return (to.tv_sec - from.tv_sec) * 1000000000LL + (to.tv_nsec - from.tv_nsec);
+}
+
+/**
+* move an instant forward
+* @param t  the instant
+* @param ns the time to add, in nanoseconds
+*/
+static void add_ns(struct timespec &t, long ns) {
+  t.tv_nsec += ns;
+  t.tv_sec += t.tv_nsec / 1000000000L;
+  t.tv_nsec %= 1000000000L;
+}
+
+/**
+* find the function and line of a sampled address
+* @param  index the address index of the process' shared objects
+* @param  ip    the address
+* @return       the address' location
+*/
+static sample_location locate(object_index &index, intptr_t ip) {
+  sample_location loc;
+  size_t hint = 0;
+  shared_obj *obj = index.find(ip, hint);
+  if (obj == nullptr) {
+    loc.function = "?? (unknown object)";
+    loc.line = "??";
+    return loc;
+  }
+
+  std::string name;
+  if (!obj->get_info()->find_function_name(obj->sys_mem_to_obj_off(ip), name)) {
+    name = "??";
+  }
+  loc.function = name + " (" + obj->get_path() + ")";
+
+  loc.line = obj->get_path() + " (no line information)";
+  if (obj->has_cus()) {
+    try {
+      auto entry = obj->get_line_entry_from_ip(ip);
+      loc.line = std::string(entry.file) + ":" + std::to_string(entry.line);
+    } catch(std::out_of_range &e) {
+      // Keep the object's path
+    }
+  }
+  return loc;
+}
+
+/**
+* print the entries with the most samples
+* @param out    the stream to print to
+* @param title  the title of the list
+* @param counts the samples of each entry
+* @param total  the samples of all entries
+* @param top    the number of entries to print, at most
+*/
+static void print_top(FILE* out, const char* title, const std::map<std::string, unsigned long> &counts,
+                      unsigned long total, size_t top) {
+  std::vector<std::pair<unsigned long, std::string>> sorted;
+  for (auto &entry : counts) {
+    sorted.push_back(std::make_pair(entry.second, entry.first));
+  }
+  // Most samples first, then by name so that the report is stable
+  std::sort(sorted.begin(), sorted.end(),
+            [](const std::pair<unsigned long, std::string> &a,
+               const std::pair<unsigned long, std::string> &b) {
+              return a.first != b.first ? a.first > b.first : a.second < b.second;
+            });
+
+  fprintf(out, "%s\n", title);
+  fprintf(out, "  Samples       %%  Location\n");
+  for (size_t i = 0; i < sorted.size() && i < top; i++) {
+    fprintf(out, "  %7lu  %5.1f%%  %s\n", sorted[i].first,
+            total > 0 ? 100.0 * sorted[i].first / total : 0.0, sorted[i].second.c_str());
+  }
+  fprintf(out, "\n");
+}
+
+/**
+* construct a new profiler
+* @param threads the threads of the profiled process
+* @param regs    the registers of the profiled threads
+* @param leader  the main thread of the process
+* @param hz      the number of samples per second
+*/
+sampling_profiler::sampling_profiler(thread_table &threads, register_cache &regs, pid_t leader,
+                                     unsigned hz)
+: threads(threads), regs(regs), leader{leader}, period_ns{1000000000L / hz},
+  leader_exiting{false}, num_samples{0} {
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  stop = start;
+  next_tick = start;
+  add_ns(next_tick, period_ns);
+}
+
+/**
+* run the process, sampling its threads. Stops when the main thread is
+*   about to exit, so that the process' mappings can be read while they
+*   still exist. Calling run() again resumes the main thread.
+* @return true if the main thread is about to exit, false if every
+*         thread exited
+*/
+bool sampling_profiler::run() {
+  if (leader_exiting) {
+    leader_exiting = false;
+    resume(leader, 0);
+  }
+
+  thread_event event;
+  while (true) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long wait_ns = elapsed_ns(now, next_tick);
+    if (wait_ns <= 0) {
+      interrupt_all();
+      // Ticks missed while busy are skipped rather than sampled in a burst
+      add_ns(next_tick, period_ns);
+      if (elapsed_ns(now, next_tick) <= 0) {
+        next_tick = now;
+        add_ns(next_tick, period_ns);
+      }
+      continue;
+    }
+
+    // Waits are in whole milliseconds, so round up to not wake up early
+    int waited = threads.next_event(event, (wait_ns + 999999) / 1000000);
+    if (waited < 0) {
+      clock_gettime(CLOCK_MONOTONIC, &stop);
+      return false;
+    }
+    if (waited == 0) {
+      continue;
+    }
+
+    pid_t tid = event.tid;
+    if (event.type == thread_event::EXITED) {
+      regs.thread_exited(tid);
+      continue;
+    }
+
+    thread_info &thread = *threads.find(tid);
+    switch (event.type) {
+      case thread_event::INTERRUPT:
+        // Group-stops are reported the same way, and are not samples. The
+        //   thread is resumed either way, so job control stops are ignored.
+        if (thread.interrupted) {
+          thread.interrupted = false;
+          samples[tid][regs.get_ip(tid)]++;
+          num_samples++;
+        }
+        resume(tid, 0);
+        break;
+      case thread_event::EXITING:
+        if (tid == leader) {
+          leader_exiting = true;
+          return true;
+        }
+        resume(tid, 0);
+        break;
+      case thread_event::TRAP:
+        // Without single-steps or breakpoints, SIGTRAP is the program's own
+        resume(tid, SIGTRAP);
+        break;
+      case thread_event::SIGNAL:
+        resume(tid, event.sig);
+        break;
+      default:
+        resume(tid, 0);
+        break;
+    }
+  }
+}
+
+/**
+* print the functions and lines with the most samples, for all threads
+*   and for each thread
+* @param out   the stream to print to
+* @param index the address index of the process' shared objects
+*/
+void sampling_profiler::print_report(FILE* out, object_index &index) {
+  double seconds = elapsed_ns(start, stop) / 1e9;
+  fprintf(out, "Profile: %lu samples of %lu threads in %.3f s (%.0f samples/s)\n\n",
+          num_samples, (unsigned long)samples.size(), seconds,
+          seconds > 0 ? num_samples / seconds : 0.0);
+
+  // Each address is symbolized once, however many threads it was sampled in
+  std::unordered_map<intptr_t, sample_location> locations;
+  std::map<std::string, unsigned long> functions, lines;
+  std::map<pid_t, std::pair<std::map<std::string, unsigned long>,
+                            std::map<std::string, unsigned long>>> per_thread;
+  for (auto &thread : samples) {
+    auto &counts = per_thread[thread.first];
+    for (auto &sample : thread.second) {
+      auto it = locations.find(sample.first);
+      if (it == locations.end()) {
+        it = locations.emplace(sample.first, locate(index, sample.first)).first;
+      }
+      functions[it->second.function] += sample.second;
+      lines[it->second.line] += sample.second;
+      counts.first[it->second.function] += sample.second;
+      counts.second[it->second.line] += sample.second;
+    }
+  }
+
+  print_top(out, "Hot functions, all threads:", functions, num_samples, PROFILE_TOP);
+  print_top(out, "Hot lines, all threads:", lines, num_samples, PROFILE_TOP);
+
+  // Threads in creation order, which mostly follows their IDs
+  for (auto &thread : per_thread) {
+    unsigned long total = 0;
+    for (auto &function : thread.second.first) {
+      total += function.second;
+    }
+    fprintf(out, "Thread ID (PID): %d | %lu samples\n\n", thread.first, total);
+    print_top(out, "Hot functions:", thread.second.first, total, PROFILE_THREAD_TOP);
+    print_top(out, "Hot lines:", thread.second.second, total, PROFILE_THREAD_TOP);
+  }
+  fflush(out);
+}
+
+/**
+* interrupt every running thread that is not already interrupted
+*/
+void sampling_profiler::interrupt_all() {
+  for (auto &thread : threads) {
+    thread_info &info = thread.second;
+    if (info.state == thread_state::RUNNING && !info.interrupted
+        && ptrace(PTRACE_INTERRUPT, info.tid, NULL, NULL) == 0) {
+      info.interrupted = true;
+    }
+  }
+}
+
+/**
+* resume a stopped thread
+* @param tid the thread
+* @param sig the signal to deliver, or 0
+*/
+void sampling_profiler::resume(pid_t tid, int sig) {
+  regs.invalidate(tid);
+  ptrace(PTRACE_CONT, tid, NULL, sig);
+  thread_info *thread = threads.find(tid);
+  if (thread != nullptr) {
+    thread->state = thread_state::RUNNING;
+  }
+}
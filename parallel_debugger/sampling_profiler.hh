@@ -0,0 +1,84 @@
+#ifndef _SAMPLING_PROFILER_HH_
+#define _SAMPLING_PROFILER_HH_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <unordered_map>
+
+#include "object_index.hh"
+#include "register_cache.hh"
+#include "thread_table.hh"
+
+/**
+ * Samples where the threads of a process spend their time. The process
+ *   runs at full speed, attached with PTRACE_SEIZE, and every period all
+ *   running threads are stopped with PTRACE_INTERRUPT, their instruction
+ *   pointers recorded, and resumed. Samples are counted per thread and
+ *   address, and only symbolized in the final report, so a sample costs a
+ *   few ptrace calls.
+ */
+class sampling_profiler {
+public:
+
+  /**
+  * construct a new profiler
+  * @param threads the threads of the profiled process
+  * @param regs    the registers of the profiled threads
+  * @param leader  the main thread of the process
+  * @param hz      the number of samples per second
+  */
+  sampling_profiler(thread_table &threads, register_cache &regs, pid_t leader, unsigned hz);
+
+  /**
+  * run the process, sampling its threads. Stops when the main thread is
+  *   about to exit, so that the process' mappings can be read while they
+  *   still exist. Calling run() again resumes the main thread.
+  * @return true if the main thread is about to exit, false if every
+  *         thread exited
+  */
+  bool run();
+
+  /**
+  * print the functions and lines with the most samples, for all threads
+  *   and for each thread
+  * @param out   the stream to print to
+  * @param index the address index of the process' shared objects
+  */
+  void print_report(FILE* out, object_index &index);
+
+  /**
+  * @return the number of samples taken
+  */
+  auto get_samples() const -> unsigned long { return num_samples; }
+
+private:
+  /**
+  * interrupt every running thread that is not already interrupted
+  */
+  void interrupt_all();
+
+  /**
+  * resume a stopped thread
+  * @param tid the thread
+  * @param sig the signal to deliver, or 0
+  */
+  void resume(pid_t tid, int sig);
+
+  thread_table &threads;     // Threads of the profiled process
+  register_cache &regs;      // Registers of the profiled threads
+  pid_t leader;              // Main thread of the process
+  long period_ns;            // Time between samples
+  struct timespec next_tick; // When the next sample is due
+  bool leader_exiting;       // Whether the main thread is stopped at its exit
+  unsigned long num_samples; // Samples taken
+  struct timespec start;     // When profiling started
+  struct timespec stop;      // When the last thread exited
+  std::unordered_map<pid_t, std::unordered_map<intptr_t, unsigned long>> samples; // Samples of
+                             //   each thread, per address
+};
+
+#endif /* _SAMPLING_PROFILER_HH_ */
@@ -0,0 +1,233 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <algorithm>
+
+#include "scheduler.hh"
+
+// Schedule points after which a blocked thread may be chosen again
+#define BLOCKED_RETRY_POINTS 64
+
+// Default PCT depth and expected number of steps
+#define PCT_DEFAULT_DEPTH 3
+#define PCT_DEFAULT_STEPS 10000
+
+/**
+* create a policy from its description
+* @param  spec rr[:<quantum>], random:<seed> or pct:<seed>[:<depth>[:<steps>]]
+* @return      the policy, or nullptr if spec is not valid
+*/
+std::unique_ptr<schedule_policy> schedule_policy::parse(const char* spec) {
+  // Split the numbers following the policy name
+  const char* colon = strchr(spec, ':');
+  size_t name_len = colon ? (size_t)(colon - spec) : strlen(spec);
+  std::vector<unsigned long long> args;
+  while (colon != NULL) {
+    char* end;
+    args.push_back(strtoull(colon + 1, &end, 0));
+    if (end == colon + 1 || (*end != ':' && *end != '\0')) {
+      return nullptr;
+    }
+    colon = *end == ':' ? end : NULL;
+  }
+
+  std::unique_ptr<schedule_policy> policy;
+  if (strncmp(spec, "rr", name_len) == 0 && name_len == 2 && args.size() <= 1) {
+    unsigned long quantum = args.empty() ? 1 : args[0];
+    if (quantum > 0) {
+      policy.reset(new round_robin_policy{quantum});
+    }
+  } else if (strncmp(spec, "random", name_len) == 0 && name_len == 6 && args.size() == 1) {
+    policy.reset(new random_policy{args[0]});
+  } else if (strncmp(spec, "pct", name_len) == 0 && name_len == 3
+             && args.size() >= 1 && args.size() <= 3) {
+    unsigned depth = args.size() > 1 ? args[1] : PCT_DEFAULT_DEPTH;
+    unsigned long steps = args.size() > 2 ? args[2] : PCT_DEFAULT_STEPS;
+    if (depth > 0 && steps > 0) {
+      policy.reset(new pct_policy{args[0], depth, steps});
+    }
+  }
+  return policy;
+}
+
+/**
+* choose the next thread to run
+* @param  candidates the threads that may run, in creation order
+* @param  last       the thread that ran last, or 0
+* @return            the index of the chosen thread in candidates
+*/
+size_t round_robin_policy::pick(const std::vector<pid_t> &candidates, pid_t last) {
+  auto it = std::find(candidates.begin(), candidates.end(), last);
+  if (it != candidates.end() && ++used < quantum) {
+    // Finish the last thread's turn
+    return it - candidates.begin();
+  }
+
+  // Next thread in creation order. When the last thread left the candidates,
+  //   its successor moved into its index.
+  if (it != candidates.end()) {
+    last_index = (it - candidates.begin() + 1) % candidates.size();
+  } else {
+    last_index %= candidates.size();
+  }
+  used = 0;
+  return last_index;
+}
+
+/**
+* choose the next thread to run
+* @param  candidates the threads that may run, in creation order
+* @param  last       the thread that ran last, or 0
+* @return            the index of the chosen thread in candidates
+*/
+size_t random_policy::pick(const std::vector<pid_t> &candidates, pid_t) {
+  // std::uniform_int_distribution differs between standard libraries
+  return rng() % candidates.size();
+}
+
+/**
+* construct a new PCT policy
+* @param seed  the random seed
+* @param depth the number of ordering constraints to find
+* @param steps the expected number of steps of the run
+*/
+pct_policy::pct_policy(uint64_t seed, unsigned depth, unsigned long steps)
+: rng{seed}, depth{depth}, step{0} {
+  for (unsigned i = 1; i < depth; i++) {
+    change_points.push_back(1 + rng() % steps);
+  }
+  std::sort(change_points.begin(), change_points.end());
+}
+
+/**
+* register a new thread
+* @param tid the new thread
+*/
+void pct_policy::thread_created(pid_t tid) {
+  // Initial priorities are above depth, so that the lowered ones stay below
+  priorities[tid] = depth + (rng() >> 1);
+}
+
+/**
+* choose the next thread to run
+* @param  candidates the threads that may run, in creation order
+* @param  last       the thread that ran last, or 0
+* @return            the index of the chosen thread in candidates
+*/
+size_t pct_policy::pick(const std::vector<pid_t> &candidates, pid_t last) {
+  // At the i-th change point, the running thread drops to priority depth - i
+  step++;
+  for (size_t i = 0; i < change_points.size(); i++) {
+    if (change_points[i] == step && priorities.count(last)) {
+      priorities[last] = depth - 1 - i;
+    }
+  }
+
+  size_t best = 0;
+  for (size_t i = 1; i < candidates.size(); i++) {
+    if (priorities[candidates[i]] > priorities[candidates[best]]) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+/**
+* add a new thread, which stays stopped until it is chosen
+* @param tid the new thread
+*/
+void scheduler::add(pid_t tid) {
+  threads.push_back(sched_thread{tid, false, 0, false, 0});
+  policy->thread_created(tid);
+}
+
+/**
+* remove a thread that exited
+* @param tid the thread
+*/
+void scheduler::remove(pid_t tid) {
+  threads.erase(std::remove_if(threads.begin(), threads.end(),
+                               [tid](const sched_thread &t) { return t.tid == tid; }),
+                threads.end());
+  if (running == tid) {
+    running = 0;
+  }
+}
+
+/**
+* stop running a thread
+* @param tid     the thread, which is stopped
+* @param blocked whether the thread was stopped because it did not make
+*                progress
+*/
+void scheduler::park(pid_t tid, bool blocked) {
+  for (auto &t : threads) {
+    if (t.tid == tid) {
+      t.blocked = blocked;
+      t.blocked_at = points;
+      t.waiting = false;
+    }
+  }
+  if (running == tid) {
+    running = 0;
+  }
+}
+
+/**
+* stop running a thread that is about to wait for an object held by
+*   another thread, such as a mutex. It is not chosen until the object is
+*   released.
+* @param tid    the thread, which is stopped
+* @param object the object the thread waits for
+*/
+void scheduler::park_waiting(pid_t tid, uintptr_t object) {
+  park(tid, false);
+  for (auto &t : threads) {
+    if (t.tid == tid) {
+      t.waiting = true;
+      t.object = object;
+    }
+  }
+}
+
+/**
+* let the threads waiting for an object be chosen again
+* @param object the released object
+*/
+void scheduler::release(uintptr_t object) {
+  for (auto &t : threads) {
+    if (t.waiting && t.object == object) {
+      t.waiting = false;
+    }
+  }
+}
+
+/**
+* choose the next thread to run
+* @return the chosen thread, or 0 if no thread is left
+*/
+pid_t scheduler::next() {
+  if (threads.empty()) {
+    return 0;
+  }
+  points++;
+
+  // Leave out the threads waiting for an object or found blocked recently,
+  //   unless all of them are
+  std::vector<pid_t> candidates;
+  for (auto &t : threads) {
+    if (!t.waiting && (!t.blocked || points - t.blocked_at >= BLOCKED_RETRY_POINTS)) {
+      candidates.push_back(t.tid);
+    }
+  }
+  if (candidates.empty()) {
+    for (auto &t : threads) {
+      candidates.push_back(t.tid);
+    }
+  }
+
+  running = last = candidates[policy->pick(candidates, last)];
+  return running;
+}
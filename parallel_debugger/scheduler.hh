@@ -0,0 +1,193 @@
+#ifndef _SCHEDULER_HH_
+#define _SCHEDULER_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Chooses which thread runs at each schedule point. Policies only see
+ *   threads in creation order, never thread IDs as numbers, so that a seed
+ *   reproduces the same interleaving although the IDs change between runs.
+ */
+class schedule_policy {
+public:
+  virtual ~schedule_policy() {}
+
+  /**
+  * register a new thread
+  * @param tid the new thread
+  */
+  virtual void thread_created(pid_t) {}
+
+  /**
+  * choose the next thread to run
+  * @param  candidates the threads that may run, in creation order
+  * @param  last       the thread that ran last, or 0
+  * @return            the index of the chosen thread in candidates
+  */
+  virtual size_t pick(const std::vector<pid_t> &candidates, pid_t last) = 0;
+
+  /**
+  * create a policy from its description
+  * @param  spec rr[:<quantum>], random:<seed> or pct:<seed>[:<depth>[:<steps>]]
+  * @return      the policy, or nullptr if spec is not valid
+  */
+  static std::unique_ptr<schedule_policy> parse(const char* spec);
+};
+
+/**
+ * Round-robin: each thread runs for a quantum of steps, in creation order
+ */
+class round_robin_policy : public schedule_policy {
+public:
+  round_robin_policy(unsigned long quantum)
+  : quantum{quantum}, used{0}, last_index{0}
+  {}
+
+  size_t pick(const std::vector<pid_t> &candidates, pid_t last) override;
+
+private:
+  unsigned long quantum;  // Steps per turn
+  unsigned long used;     // Steps used by the last thread in its turn
+  size_t last_index;      // Index of the last thread among the candidates
+};
+
+/**
+ * Random: a uniformly random thread at every step
+ */
+class random_policy : public schedule_policy {
+public:
+  random_policy(uint64_t seed)
+  : rng{seed}
+  {}
+
+  size_t pick(const std::vector<pid_t> &candidates, pid_t last) override;
+
+private:
+  std::mt19937_64 rng;    // Specified by the standard, so seeds are portable
+};
+
+/**
+ * PCT (probabilistic concurrency testing): the highest-priority thread always
+ *   runs. Threads get random priorities above depth, and at depth - 1 random
+ *   steps the running thread drops to a priority below all the others. A bug
+ *   that needs depth ordering constraints is found with probability at least
+ *   1 / (threads * steps^(depth - 1)).
+ */
+class pct_policy : public schedule_policy {
+public:
+
+  /**
+  * construct a new PCT policy
+  * @param seed  the random seed
+  * @param depth the number of ordering constraints to find
+  * @param steps the expected number of steps of the run
+  */
+  pct_policy(uint64_t seed, unsigned depth, unsigned long steps);
+
+  void thread_created(pid_t tid) override;
+
+  size_t pick(const std::vector<pid_t> &candidates, pid_t last) override;
+
+private:
+  std::mt19937_64 rng;                           // Source of priorities
+  unsigned depth;                                // Number of ordering constraints
+  unsigned long step;                            // Steps so far
+  std::vector<unsigned long> change_points;      // Steps that lower a priority, sorted
+  std::unordered_map<pid_t, uint64_t> priorities; // Priority of each thread
+};
+
+/**
+ * Keeps every traced thread stopped except one, and chooses the running
+ *   thread at each schedule point with a policy. A thread about to wait for
+ *   an object held by a stopped thread, e.g. a mutex, is only chosen once
+ *   the object is released. Threads found blocked otherwise, by a timeout,
+ *   are only chosen again after a number of schedule points. Either kind is
+ *   chosen when every thread waits or is blocked.
+ */
+class scheduler {
+public:
+
+  /**
+  * construct a new scheduler
+  * @param policy the policy choosing the running thread
+  */
+  scheduler(std::unique_ptr<schedule_policy> policy)
+  : policy{std::move(policy)}, running{0}, last{0}, points{0}
+  {}
+
+  /**
+  * add a new thread, which stays stopped until it is chosen
+  * @param tid the new thread
+  */
+  void add(pid_t tid);
+
+  /**
+  * remove a thread that exited
+  * @param tid the thread
+  */
+  void remove(pid_t tid);
+
+  /**
+  * stop running a thread
+  * @param tid     the thread, which is stopped
+  * @param blocked whether the thread was stopped because it did not make
+  *                progress
+  */
+  void park(pid_t tid, bool blocked);
+
+  /**
+  * stop running a thread that is about to wait for an object held by
+  *   another thread, such as a mutex. It is not chosen until the object is
+  *   released.
+  * @param tid    the thread, which is stopped
+  * @param object the object the thread waits for
+  */
+  void park_waiting(pid_t tid, uintptr_t object);
+
+  /**
+  * let the threads waiting for an object be chosen again
+  * @param object the released object
+  */
+  void release(uintptr_t object);
+
+  /**
+  * choose the next thread to run
+  * @return the chosen thread, or 0 if no thread is left
+  */
+  pid_t next();
+
+  /**
+  * @return the running thread, or 0 if none is running
+  */
+  auto get_running() const -> pid_t { return running; }
+
+  /**
+  * @return the number of schedule points so far
+  */
+  auto get_points() const -> uint64_t { return points; }
+
+private:
+  // A thread known to the scheduler
+  struct sched_thread {
+    pid_t tid;           // Thread ID
+    bool blocked;        // Whether the thread did not make progress last time
+    uint64_t blocked_at; // Schedule point where it was found blocked
+    bool waiting;        // Whether the thread waits for an object
+    uintptr_t object;    // The object the thread waits for
+  };
+
+  std::unique_ptr<schedule_policy> policy; // Chooses the running thread
+  std::vector<sched_thread> threads;       // Live threads, in creation order
+  pid_t running;                           // Running thread, or 0
+  pid_t last;                              // Thread that ran last
+  uint64_t points;                         // Schedule points so far
+};
+
+#endif /* _SCHEDULER_HH_ */
@@ -1,49 +1,22 @@
 #include <inttypes.h>
-#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include <sys/ptrace.h>
-#include <unistd.h>
 
 #include "shared_object.hh"
 
 /**
-* construct a new shared object
-* @param file_path  the absolute path of the shared object file
+* construct a new shared object from one mapping of a file
+* @param info       the debugging information of the mapped file
 * @param addr_start the starting address where the shared object is loaded in
 *                   system memory
 * @param addr_end   the end address of the shared object in system memory
+* @param offset     the file offset mapped at addr_start
 */
-shared_obj::shared_obj(std::string file_path, intptr_t addr_start, intptr_t addr_end) {
-
-  int fd = open(file_path.c_str(), O_RDONLY);
-
-  // Check if this is a readable file
-  if( fd == -1 ) {
-    throw std::invalid_argument{"Cannot open file '" + file_path + "'"};
-  }
-
-  // file exists
-  this->path = file_path;
-
-  this->addr_start = addr_start;
-  this->addr_end = addr_end;
-
-  // Initialize this shared object's fields
-  try {
-    elf::elf elf(elf::create_mmap_loader(fd));
-    dwarf::dwarf dwarf(dwarf::elf::create_loader(elf));
-    // ELF type (exec or dynamic)
-    this->type = elf.get_hdr().type;
-    this->compilation_units = dwarf.compilation_units();
-    this->has_compilation_units = true;
-  } catch(dwarf::format_error& e) {
-    // If file is not a valid dwarf file
-    this->has_compilation_units = false;
-  }
-
-  // Wrap up
-  close(fd);
+shared_obj::shared_obj(std::shared_ptr<debug_info> info, intptr_t addr_start,
+                       intptr_t addr_end, uint64_t offset)
+: addr_start{addr_start}, addr_end{addr_end}, offset{offset}, info{info} {
+  this->bias = info->load_bias(addr_start, offset);
 }
 
 /**
@@ -52,7 +25,8 @@ shared_obj::shared_obj(std::string file_path, intptr_t addr_start, intptr_t addr
 * @return    true if ip is contained within this shared object, false otherwise.
 */
 bool shared_obj::contains(intptr_t ip) {
-  return (addr_start <= ip) && (ip <= addr_end);
+  // The end address in the maps file is exclusive
+  return (addr_start <= ip) && (ip < addr_end);
 }
 
 /**
@@ -62,21 +36,8 @@ bool shared_obj::contains(intptr_t ip) {
 * @return    the corresponding address relative to the start of the file
 */
 intptr_t shared_obj::sys_mem_to_obj_off(intptr_t ip) {
-  switch (type) {
-    case elf::et::exec:
-    // exec files have relative addresses
-    return ip;
-    break;
-
-    case elf::et::dyn:
-    // dynamic files have absolute addresses
-    return ip - addr_start;
-    break;
-
-    default:
-    // We don't consider other types
-    return ip;
-  }
+  // The bias is zero for executables, which have absolute addresses
+  return ip - bias;
 }
 
 /**
@@ -85,50 +46,54 @@ intptr_t shared_obj::sys_mem_to_obj_off(intptr_t ip) {
 * @return    the corresponding instruction pointer to a system memory address
 */
 intptr_t shared_obj::obj_off_to_sys_mem(intptr_t ip) {
-  switch (type) {
-    case elf::et::exec:
-    // exec files have relative addresses
-    return ip;
-    break;
-
-    case elf::et::dyn:
-    // dynamic files have absolute addresses
-    return ip + addr_start;
-    break;
-
-    default:
-    // We don't consider other types
-    return ip;
-  }
+  // The bias is zero for executables, which have absolute addresses
+  return ip + bias;
 }
 
 /**
 * get the line table entry corresponding to the given instruction pointer
 * @param  ip an instruction pointer within a shared object file
-* @return    the corresponding dwarf line table entry
+* @return    the file, line and address range of the corresponding entry
 * @throws    std::out_of_range if no line entry is found
-* Source:
-* https://blog.tartanllama.xyz/writing-a-linux-debugger-source-signal/
 */
-dwarf::line_table::iterator shared_obj::get_line_entry_from_ip(intptr_t ip) {
+line_info shared_obj::get_line_entry_from_ip(intptr_t ip) {
   /* calculate offset of the instruction pointer from the beginning of the file */
   intptr_t file_off = sys_mem_to_obj_off(ip);
 
-  /* walk through the each compilation unit's line table to find the line */
-  for (auto &cu : compilation_units) {
-    if (die_pc_range(cu.root()).contains(file_off)) {
-      auto &lt = cu.get_line_table();
-      auto it = lt.find_address(file_off);
-      if (it == lt.end()) {
-        throw std::out_of_range{"Cannot find line entry"};
-      }
-      else {
-        return it;
-      }
-    }
+  /* binary search the flattened line tables */
+  line_info info;
+  if (!this->info->find_line(file_off, info)) {
+    throw std::out_of_range{"Cannot find line entry"};
+  }
+  return info;
+}
+
+/**
+* get the line table rows of the function containing an instruction pointer
+* @param  ip     an instruction pointer within a shared object file
+* @param  rows   a vector to append the rows' file, line and system memory
+*                address range to
+* @param  starts a vector to append the system memory address of each of
+*                the function's ranges to
+* @return        true if a function was found, false otherwise
+*/
+bool shared_obj::get_function_rows(intptr_t ip, std::vector<line_info> &rows,
+                                   std::vector<intptr_t> &starts) {
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+  if (!info->get_function_ranges(sys_mem_to_obj_off(ip), ranges)) {
+    return false;
   }
 
-  throw std::out_of_range{"Cannot find line entry"};
+  size_t first = rows.size();
+  for (auto &range : ranges) {
+    info->get_line_rows(range.first, range.second, rows);
+    starts.push_back(obj_off_to_sys_mem(range.first));
+  }
+  for (size_t i = first; i < rows.size(); i++) {
+    rows[i].address = obj_off_to_sys_mem(rows[i].address);
+    rows[i].end = obj_off_to_sys_mem(rows[i].end);
+  }
+  return true;
 }
 
 /**
@@ -137,48 +102,9 @@ dwarf::line_table::iterator shared_obj::get_line_entry_from_ip(intptr_t ip) {
 * @param  name the name of the function to be looked up
 * @return      the corresponding dwarf line table entry
 * @throws      std::out_of_range if no line entry is found
-* Source:
-* https://blog.tartanllama.xyz/writing-a-linux-debugger-source-signal/
 */
 dwarf::line_table::iterator shared_obj::get_line_entry_from_function(const std::string& name) {
-  /* walk through the each compilation unit's line table to find the line */
-  for (const auto& cu : compilation_units) {
-    for (const auto& die : cu.root()) {
-      if (die.has(dwarf::DW_AT::name) && at_name(die) == name) {
-        // Find lowest address for this function DIE
-        auto low_ip = at_low_pc(die);
-        auto &lt = cu.get_line_table();
-        auto entry = lt.find_address(low_ip);
-        if (entry == lt.end()) {
-          throw std::out_of_range{"Cannot find line entry"};
-        }
-        else {
-          // skip function prologue to point to actual user code
-          return ++entry;
-        }
-      }
-    }
-  }
-  throw std::out_of_range{"Cannot find line entry"};
-}
-
-/********************
-* TESTING FUNCTIONS *
-*********************/
-/**
- * Print to stdin each entry of the given line table, in the following format
- *   <file path> <line number> <instruction address>
- * @param lt a line table
- */
-void dump_line_table(const dwarf::line_table &lt)
-{
-  for (auto &line : lt) {
-    if (line.end_sequence)
-    printf("\n");
-    else
-    printf("%-40s%8d%#20" PRIx64 "\n", line.file->path.c_str(),
-    line.line, line.address);
-  }
+  return info->get_line_entry_from_function(name);
 }
 
 /**
@@ -186,11 +112,7 @@ void dump_line_table(const dwarf::line_table &lt)
  *   shared object
  */
 void shared_obj::dump_all_line_tables() {
-  for (auto cu : compilation_units) {
-    printf("--- <%x>\n", (unsigned int)cu.get_section_offset());
-    dump_line_table(cu.get_line_table());
-    printf("\n");
-  }
+  info->dump_all_line_tables();
 }
 
 /**
@@ -199,5 +121,112 @@ void shared_obj::dump_all_line_tables() {
  *  <start address>-<end address> <ELF type> <file path>
  */
 void shared_obj::print_string_form() {
-  printf("%lx-%lx\t%hu %s\n", addr_start, addr_end, type, path.c_str());
+  printf("%lx-%lx\t%hu %s\n", addr_start, addr_end, info->get_type(), get_path().c_str());
+}
+
+/**
+* print the name of a function, and of the function it was inlined into
+* @param out   the stream to print to
+* @param name  the name of the function
+* @param outer the name of the function it was inlined into, or nullptr
+*/
+static void print_function(FILE* out, const char* name, const char* outer) {
+  if (outer != nullptr) {
+    fprintf(out, "Function: %s [inlined into %s]\n", name, outer);
+  } else {
+    fprintf(out, "Function: %s\n", name);
+  }
+}
+
+/**
+* print the source file and line of an instruction, or the object's path
+*   if they are unknown
+* @param  out the stream to print to
+* @param  obj a shared object entry
+* @param  rip instruction pointer
+* @return     true if the line is found, false otherwise
+*/
+static bool print_source_line(FILE* out, shared_obj &obj, intptr_t rip) {
+  /* return value set to false */
+  bool found = false;
+
+  /* if the object has line table */
+  if (obj.has_cus())  {
+    try {
+      auto entry = obj.get_line_entry_from_ip(rip);
+      /* If we find the line, print it */
+      fprintf(out, "File path: %s\n", entry.file);
+      fprintf(out, "Called from line %u\n\n", entry.line);
+      found = true;
+    } catch(std::out_of_range &e) {
+      /* Line was not found */
+      fprintf(out, "File path: %s\n", obj.get_path().c_str());
+      fprintf(out, "No line numbers found.\n\n");
+    }
+  } else {
+    fprintf(out, "File path: %s\n", obj.get_path().c_str());
+    fprintf(out, "No debug information available.\n\n");
+  }
+  return found;
+}
+
+/**
+* Given an instruction pointer and its object, find line info
+* @param  out the stream to print to
+* @param  obj a shared object entry
+* @param  rip instruction pointer
+* @return     true if the line is found, false otherwise
+*/
+bool print_line_info(FILE* out, shared_obj &obj, intptr_t rip) {
+  /* Name the function, even in code without line information */
+  function_info function;
+  if (obj.get_info()->find_function_at(obj.sys_mem_to_obj_off(rip), function)) {
+    print_function(out, function.name, function.outer);
+  }
+  return print_source_line(out, obj, rip);
+}
+
+/**
+* Given an instruction pointer of a thread and its object, find line info.
+*   The thread's last line row and function range are cached, so that the
+*   instructions of a row are only looked up once.
+* @param  out    the stream to print to
+* @param  obj    a shared object entry
+* @param  thread the thread executing the instruction
+* @param  rip    instruction pointer
+* @return        true if the line is found, false otherwise
+*/
+bool print_thread_line(FILE* out, shared_obj &obj, thread_info &thread, intptr_t rip) {
+  if (thread.function == nullptr || rip < thread.func_start || rip >= thread.func_end) {
+    thread.function = nullptr;
+    function_info function;
+    if (obj.get_info()->find_function_at(obj.sys_mem_to_obj_off(rip), function)) {
+      thread.func_start = obj.obj_off_to_sys_mem(function.address);
+      thread.func_end = obj.obj_off_to_sys_mem(function.end);
+      thread.function = function.name;
+      thread.inlined_into = function.outer;
+    }
+  }
+  if (thread.function != nullptr) {
+    print_function(out, thread.function, thread.inlined_into);
+  }
+
+  if (thread.file == nullptr || rip < thread.row_start || rip >= thread.row_end) {
+    thread.file = nullptr;
+    if (!obj.has_cus()) {
+      return print_source_line(out, obj, rip);
+    }
+    try {
+      auto entry = obj.get_line_entry_from_ip(rip);
+      thread.row_start = obj.obj_off_to_sys_mem(entry.address);
+      thread.row_end = obj.obj_off_to_sys_mem(entry.end);
+      thread.file = entry.file;
+      thread.line = entry.line;
+    } catch(std::out_of_range &e) {
+      return print_source_line(out, obj, rip);
+    }
+  }
+  fprintf(out, "File path: %s\n", thread.file);
+  fprintf(out, "Called from line %u\n\n", thread.line);
+  return true;
 }
@@ -1,23 +1,31 @@
 #ifndef _SHARED_OBJECT_HH_
 #define _SHARED_OBJECT_HH_
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 
+#include <memory>
+
 #include "elf++.hh"
 #include "dwarf++.hh"
+#include "debug_info.hh"
+#include "line_index.hh"
+#include "thread_table.hh"
 
 class shared_obj {
 public:
-  
+
   /**
-  * construct a new shared object
-  * @param file_path  the absolute path of the shared object file
+  * construct a new shared object from one mapping of a file
+  * @param info       the debugging information of the mapped file
   * @param addr_start the starting address where the shared object is loaded in
   *                   system memory
   * @param addr_end   the end address of the shared object in system memory
+  * @param offset     the file offset mapped at addr_start
   */
-  shared_obj(std::string file_path, intptr_t addr_start, intptr_t addr_end);
+  shared_obj(std::shared_ptr<debug_info> info, intptr_t addr_start, intptr_t addr_end,
+             uint64_t offset);
 
   /**
   * checks whether debugging (line number) information could be obtained for
@@ -25,12 +33,32 @@ public:
   * @return true if this shared object has associated compilation_units;
   *         false otherwise.
   */
-  auto has_cus() const -> bool { return has_compilation_units; }
+  auto has_cus() const -> bool { return info->has_cus(); }
 
   /**
   * @return absolute path of the shared object file
   */
-  auto get_path() const -> std::string { return path; }
+  auto get_path() const -> std::string { return info->get_path(); }
+
+  /**
+  * @return the starting address of the shared object in system memory
+  */
+  auto get_start() const -> intptr_t { return addr_start; }
+
+  /**
+  * @return the end address (exclusive) of the shared object in system memory
+  */
+  auto get_end() const -> intptr_t { return addr_end; }
+
+  /**
+  * @return the file offset mapped at the starting address
+  */
+  auto get_offset() const -> uint64_t { return offset; }
+
+  /**
+  * @return the debugging information of the shared object file
+  */
+  auto get_info() const -> const std::shared_ptr<debug_info>& { return info; }
 
   /**
   * check whether an insturction address is contained withtin this shared object
@@ -57,12 +85,22 @@ public:
   /**
   * get the line table entry corresponding to the given instruction pointer
   * @param  ip an instruction pointer within a shared object file
-  * @return    the corresponding dwarf line table entry
+  * @return    the file, line and address range of the corresponding entry
   * @throws    std::out_of_range if no line entry is found
-  * Source:
-  * https://blog.tartanllama.xyz/writing-a-linux-debugger-source-signal/
   */
-  dwarf::line_table::iterator get_line_entry_from_ip(intptr_t ip);
+  line_info get_line_entry_from_ip(intptr_t ip);
+
+  /**
+  * get the line table rows of the function containing an instruction pointer
+  * @param  ip     an instruction pointer within a shared object file
+  * @param  rows   a vector to append the rows' file, line and system memory
+  *                address range to
+  * @param  starts a vector to append the system memory address of each of
+  *                the function's ranges to
+  * @return        true if a function was found, false otherwise
+  */
+  bool get_function_rows(intptr_t ip, std::vector<line_info> &rows,
+                         std::vector<intptr_t> &starts);
 
   /**
   * get the line table entry corresponding to the first instruction of the
@@ -70,8 +108,6 @@ public:
   * @param  name the name of the function to be looked up
   * @return      the corresponding dwarf line table entry
   * @throws      std::out_of_range if no line entry is found
-  * Source:
-  * https://blog.tartanllama.xyz/writing-a-linux-debugger-source-signal/
   */
   dwarf::line_table::iterator get_line_entry_from_function(const std::string& name);
 
@@ -90,10 +126,30 @@ public:
 private:
   intptr_t addr_start;        // Start address of shared object
   intptr_t addr_end;          // End address of shared object
-  std::string path;           // Absolute path of the shared object file
-  elf::et type;               // Shared object's file ELF type (executable or dynamic object)
-  bool has_compilation_units; // Whether this shared object has associated compilation units
-  std::vector<dwarf::compilation_unit> compilation_units;
+  uint64_t offset;            // File offset mapped at addr_start
+  intptr_t bias;              // Difference between system memory and file addresses
+  std::shared_ptr<debug_info> info; // Debugging information shared by all mappings of the file
 };
 
+/**
+* Given an instruction pointer and its object, find line info
+* @param  out the stream to print to
+* @param  obj a shared object entry
+* @param  rip instruction pointer
+* @return     true if the line is found, false otherwise
+*/
+bool print_line_info(FILE* out, shared_obj &obj, intptr_t rip);
+
+/**
+* Given an instruction pointer of a thread and its object, find line info.
+*   The thread's last line row is cached, so that the instructions of a row
+*   are only looked up once.
+* @param  out    the stream to print to
+* @param  obj    a shared object entry
+* @param  thread the thread executing the instruction
+* @param  rip    instruction pointer
+* @return        true if the line is found, false otherwise
+*/
+bool print_thread_line(FILE* out, shared_obj &obj, thread_info &thread, intptr_t rip);
+
 #endif /* _SHARED_OBJECT_HH_ */
@@ -0,0 +1,81 @@
+#ifndef _SPSC_RING_HH_
+#define _SPSC_RING_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+// Size of a cache line, so that the two indices do not share one
+#define CACHE_LINE_SIZE 64
+
+/**
+ * A fixed-size queue between exactly one producer thread and one consumer
+ *   thread, without locks. The producer only writes the tail index and the
+ *   consumer only writes the head index; each publishes its slots with a
+ *   release store that the other side reads with an acquire load.
+ */
+template<typename T>
+class spsc_ring {
+public:
+
+  /**
+  * construct an empty ring
+  * @param capacity the number of slots, rounded up to a power of two
+  */
+  spsc_ring(size_t capacity)
+  : head{0}, tail{0} {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots.resize(size);
+    mask = size - 1;
+  }
+
+  spsc_ring(const spsc_ring&) = delete;
+  spsc_ring& operator=(const spsc_ring&) = delete;
+
+  /**
+  * append an item. Only called by the producer.
+  * @param  item the item
+  * @return      true if the item was added, false if the ring is full
+  */
+  bool push(const T &item) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) > mask) {
+      return false;
+    }
+    slots[t & mask] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+  * remove the oldest item. Only called by the consumer.
+  * @param  item set to the item
+  * @return      true if an item was removed, false if the ring is empty
+  */
+  bool pop(T &item) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = slots[h & mask];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  // Padding keeps the indices off the cache lines of the fields before
+  //   them, without relying on over-aligned allocation
+  std::vector<T> slots;                // Items, indexed modulo the size
+  size_t mask;                         // Number of slots minus one
+  char head_pad[CACHE_LINE_SIZE];
+  std::atomic<size_t> head;            // Next slot to pop
+  char tail_pad[CACHE_LINE_SIZE];
+  std::atomic<size_t> tail;            // Next slot to push
+};
+
+#endif /* _SPSC_RING_HH_ */
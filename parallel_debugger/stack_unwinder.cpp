@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "process_memory.hh"
+#include "stack_unwinder.hh"
+
+/**
+* walk the call stack of a stopped thread
+* @param  tid        the stopped thread
+* @param  regs       the registers of the traced threads
+* @param  frames     set to the current instruction pointer, followed by
+*                    the return address of each caller, innermost first
+* @param  max_frames the number of frames to find, at most
+* @return            the number of frames found
+*/
+size_t stack_unwinder::unwind(pid_t tid, register_cache &regs, std::vector<intptr_t> &frames,
+                              size_t max_frames) {
+  frames.clear();
+  // The stack changed since the last stop
+  window_size = 0;
+
+  unwind_cursor cursor {regs.get_ip(tid), regs.get_sp(tid), regs.get_fp(tid), 0};
+  while (frames.size() < max_frames) {
+    frames.push_back(cursor.ip);
+    if (step(tid, cursor, frames.size() > 1) == unwind_kind::NONE) {
+      break;
+    }
+  }
+  return frames.size();
+}
+
+/**
+* find the return address of a stopped thread's current function, from the
+*   call frame information only, since the frame pointer may not be set up
+*   yet at the start of a function
+* @param  tid  the stopped thread
+* @param  regs the registers of the traced threads
+* @return      the return address, or 0 if the function has no call frame
+*              information
+*/
+intptr_t stack_unwinder::return_address(pid_t tid, register_cache &regs) {
+  window_size = 0;
+  unwind_cursor cursor {regs.get_ip(tid), regs.get_sp(tid), regs.get_fp(tid), 0};
+  return step(tid, cursor, false) == unwind_kind::CFI ? cursor.ip : 0;
+}
+
+/**
+* unwind one frame
+* @param  tid    the stopped thread
+* @param  cursor the frame, set to its caller's
+* @param  caller whether the frame is a caller's, whose address is a return
+*                address rather than the current instruction
+* @return        how the frame was unwound, NONE if it is the outermost one
+*                or could not be unwound
+*/
+stack_unwinder::unwind_kind stack_unwinder::step(pid_t tid, unwind_cursor &cursor, bool caller) {
+  // A return address may follow a call that ends its function, so look up
+  //   the call instead
+  intptr_t lookup = caller ? cursor.ip - 1 : cursor.ip;
+  shared_obj *obj = index.find(lookup, cursor.hint);
+  frame_row row;
+  bool has_row = obj != nullptr
+                 && obj->get_info()->get_frames().find(obj->sys_mem_to_obj_off(lookup), row);
+
+  unwind_kind kind;
+  intptr_t cfa;
+  uint64_t ret, saved_fp;
+  if (has_row && row.cfa_rule == frame_rule::REGISTER
+      && (row.cfa_reg == DWARF_REG_RSP || row.cfa_reg == DWARF_REG_RBP)) {
+    kind = unwind_kind::CFI;
+    cfa = (row.cfa_reg == DWARF_REG_RSP ? cursor.sp : cursor.fp) + row.cfa_offset;
+    // The return address is undefined in the outermost frame
+    if (row.ra_rule != frame_rule::OFFSET || !read_word(tid, cfa + row.ra_offset, ret)) {
+      return unwind_kind::NONE;
+    }
+    if (row.rbp_rule == frame_rule::OFFSET) {
+      if (!read_word(tid, cfa + row.rbp_offset, saved_fp)) {
+        return unwind_kind::NONE;
+      }
+      cursor.fp = saved_fp;
+    }
+  } else if (has_row && row.cfa_rule == frame_rule::EXPRESSION && !caller) {
+    // PLT entries compute the CFA with an expression, but only push
+    //   arguments for the lazy binder: the return address is on top
+    kind = unwind_kind::CFI;
+    cfa = cursor.sp + sizeof(uint64_t);
+    if (!read_word(tid, cursor.sp, ret)) {
+      return unwind_kind::NONE;
+    }
+  } else if (cursor.fp != 0) {
+    // No usable call frame information: assume the frame pointer chain
+    kind = unwind_kind::FRAME_POINTER;
+    cfa = cursor.fp + 2 * sizeof(uint64_t);
+    if (!read_word(tid, cursor.fp + sizeof(uint64_t), ret) || !read_word(tid, cursor.fp, saved_fp)) {
+      return unwind_kind::NONE;
+    }
+    cursor.fp = saved_fp;
+  } else {
+    return unwind_kind::NONE;
+  }
+
+  // Callers' frames are higher on the stack
+  if (ret == 0 || cfa <= cursor.sp) {
+    return unwind_kind::NONE;
+  }
+  cursor.ip = ret;
+  cursor.sp = cfa;
+  return kind;
+}
+
+/**
+* read a word of a thread's stack, through the window of stack last read
+* @param  tid   the thread
+* @param  addr  the address of the word
+* @param  value set to the word
+* @return       true if the word was read, false otherwise
+*/
+bool stack_unwinder::read_word(pid_t tid, intptr_t addr, uint64_t &value) {
+  if (addr < window_start || addr + sizeof(uint64_t) > window_start + window_size
+      || (addr - window_start) % sizeof(uint64_t) != 0) {
+    // Read the stack from the word up, since the callers' frames are above.
+    //   The stack may end before the whole window, so retry with smaller
+    //   windows.
+    window_start = addr;
+    window_size = STACK_WINDOW_SIZE;
+    while (window_size >= sizeof(uint64_t) && !read_memory(tid, addr, window, window_size)) {
+      window_size /= 2;
+    }
+    if (window_size < sizeof(uint64_t)) {
+      window_size = 0;
+      return false;
+    }
+  }
+  value = window[(addr - window_start) / sizeof(uint64_t)];
+  return true;
+}
@@ -0,0 +1,98 @@
+#ifndef _STACK_UNWINDER_HH_
+#define _STACK_UNWINDER_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <vector>
+
+#include "object_index.hh"
+#include "register_cache.hh"
+
+// Bytes of stack read at once while unwinding
+#define STACK_WINDOW_SIZE 4096
+
+/**
+ * Walks the call stack of a stopped thread with the call frame information
+ *   of the objects its frames are in. Frames without call frame information
+ *   are unwound through the frame pointer. The stack is read in windows of
+ *   several frames with a single system call each, so a backtrace usually
+ *   costs a few ptrace calls for the registers and one or two reads.
+ */
+class stack_unwinder {
+public:
+
+  /**
+  * construct a new unwinder
+  * @param index the address index of the traced process' shared objects
+  */
+  stack_unwinder(object_index &index)
+  : index(index), window_start{0}, window_size{0}
+  {}
+
+  /**
+  * walk the call stack of a stopped thread
+  * @param  tid        the stopped thread
+  * @param  regs       the registers of the traced threads
+  * @param  frames     set to the current instruction pointer, followed by
+  *                    the return address of each caller, innermost first
+  * @param  max_frames the number of frames to find, at most
+  * @return            the number of frames found
+  */
+  size_t unwind(pid_t tid, register_cache &regs, std::vector<intptr_t> &frames, size_t max_frames);
+
+  /**
+  * find the return address of a stopped thread's current function, from the
+  *   call frame information only, since the frame pointer may not be set up
+  *   yet at the start of a function
+  * @param  tid  the stopped thread
+  * @param  regs the registers of the traced threads
+  * @return      the return address, or 0 if the function has no call frame
+  *              information
+  */
+  intptr_t return_address(pid_t tid, register_cache &regs);
+
+private:
+  // How a frame was unwound
+  enum class unwind_kind {
+    CFI,           // With the call frame information of its object
+    FRAME_POINTER, // Through the saved frame pointer
+    NONE           // Not unwound: the outermost frame, or unreadable
+  };
+
+  // The registers of the frame being unwound
+  struct unwind_cursor {
+    intptr_t ip;  // Instruction pointer, or return address in callers
+    intptr_t sp;  // Stack pointer
+    intptr_t fp;  // Frame pointer
+    size_t hint;  // Object index hint
+  };
+
+  /**
+  * unwind one frame
+  * @param  tid    the stopped thread
+  * @param  cursor the frame, set to its caller's
+  * @param  caller whether the frame is a caller's, whose address is a return
+  *                address rather than the current instruction
+  * @return        how the frame was unwound, NONE if it is the outermost one
+  *                or could not be unwound
+  */
+  unwind_kind step(pid_t tid, unwind_cursor &cursor, bool caller);
+
+  /**
+  * read a word of a thread's stack, through the window of stack last read
+  * @param  tid   the thread
+  * @param  addr  the address of the word
+  * @param  value set to the word
+  * @return       true if the word was read, false otherwise
+  */
+  bool read_word(pid_t tid, intptr_t addr, uint64_t &value);
+
+  object_index &index;                               // Address index of the shared objects
+  intptr_t window_start;                             // Address of the window
+  size_t window_size;                                // Bytes in the window, 0 if none
+  uint64_t window[STACK_WINDOW_SIZE / sizeof(uint64_t)]; // Stack last read
+};
+
+#endif /* _STACK_UNWINDER_HH_ */
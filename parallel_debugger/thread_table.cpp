@@ -0,0 +1,243 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "thread_table.hh"
+
+/**
+* construct a new thread table. SIGCHLD is blocked in the tracer, so
+*   that next_event() can wait for it with a timeout.
+* @param mode how new threads are advanced
+*/
+thread_table::thread_table(step_mode mode)
+: default_mode{mode} {
+  // A blocked SIGCHLD stays pending until sigtimedwait() consumes it
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &set, NULL);
+}
+
+/**
+* add a thread, unless it is already known
+* @param  tid   the thread
+* @param  state the state of a thread that was not known
+* @return       the thread's entry
+*/
+thread_info& thread_table::add(pid_t tid, thread_state state) {
+  auto it = threads.find(tid);
+  if (it == threads.end()) {
+    thread_info info {};
+    info.tid = tid;
+    info.state = state;
+    info.mode = default_mode;
+    it = threads.emplace(tid, info).first;
+  }
+  return it->second;
+}
+
+/**
+* forget the cached line row and function of every thread, e.g. once
+*   libraries were unloaded and their addresses may be reused
+*/
+void thread_table::forget_lines() {
+  for (auto &entry : threads) {
+    entry.second.file = nullptr;
+    entry.second.function = nullptr;
+    entry.second.inlined_into = nullptr;
+  }
+}
+
+/**
+* find a thread
+* @param  tid the thread
+* @return     the thread's entry, or nullptr if it is not known
+*/
+thread_info* thread_table::find(pid_t tid) {
+  auto it = threads.find(tid);
+  return it == threads.end() ? nullptr : &it->second;
+}
+
+/**
+* wait for the next thread event, and update the table accordingly
+* @param  event      the decoded event
+* @param  timeout_ms how long to wait for an event, or -1 to wait forever
+* @return            1 if an event was returned, 0 if the timeout expired,
+*                    -1 if no thread is left
+*/
+int thread_table::next_event(thread_event &event, int timeout_ms) {
+  if (events.empty() && timeout_ms < 0) {
+    // waitid() would be the natural call, but it does not report the ptrace
+    //   event bits of the status, so use waitpid with __WALL instead
+    int status;
+    pid_t tid = waitpid(-1, &status, __WALL);
+    if (tid == -1) {
+      return -1;
+    }
+    queue_event(tid, status);
+    collect_events();
+  }
+
+  while (events.empty()) {
+    if (!collect_events()) {
+      return -1;
+    }
+    if (!events.empty()) {
+      break;
+    }
+    // Every stop or exit of a tracee raises SIGCHLD. A SIGCHLD consumed here
+    //   for an event that collect_events() already queued only costs another
+    //   round.
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    struct timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    if (sigtimedwait(&set, NULL, &timeout) == -1 && errno == EAGAIN) {
+      return 0;
+    }
+  }
+
+  event = events.front();
+  events.pop_front();
+  return 1;
+}
+
+/**
+* stop the running threads of a process other than one, e.g. while a
+*   breakpoint is lifted to step that thread over it. A thread that
+*   reports another event first keeps it queued and stays stopped; its
+*   SIGSTOP is reported later, with interrupted set.
+* @param pid    the process whose threads are stopped
+* @param except the thread left alone
+* @param paused set to the threads stopped by the SIGSTOP, to be
+*               continued by resume_paused()
+*/
+void thread_table::pause_others(pid_t pid, pid_t except, std::vector<pid_t> &paused) {
+  paused.clear();
+  // Threads of forked processes have their own memory, and tgkill fails
+  //   for them
+  std::vector<pid_t> running;
+  for (auto &entry : threads) {
+    thread_info &thread = entry.second;
+    if (thread.tid != except && thread.state == thread_state::RUNNING && !thread.interrupted
+        && syscall(SYS_tgkill, pid, thread.tid, SIGSTOP) == 0) {
+      thread.interrupted = true;
+      running.push_back(thread.tid);
+    }
+  }
+
+  // Queuing an event may add threads, so look each one up again
+  for (pid_t tid : running) {
+    int status;
+    if (waitpid(tid, &status, __WALL) != tid) {
+      continue;
+    }
+    thread_info *thread = find(tid);
+    if (thread != nullptr && WIFSTOPPED(status) && WSTOPSIG(status) == SIGSTOP
+        && (status >> 16) == 0) {
+      thread->interrupted = false;
+      thread->state = thread_state::STOPPED;
+      paused.push_back(tid);
+    } else {
+      queue_event(tid, status);
+    }
+  }
+}
+
+/**
+* continue the threads stopped by pause_others()
+* @param paused the stopped threads
+*/
+void thread_table::resume_paused(const std::vector<pid_t> &paused) {
+  for (pid_t tid : paused) {
+    thread_info *thread = find(tid);
+    if (thread != nullptr) {
+      thread->state = thread_state::RUNNING;
+      ptrace(PTRACE_CONT, tid, NULL, NULL);
+    }
+  }
+}
+
+/**
+* queue the events of every thread that is already stopped
+* @return false if no thread is left, true otherwise
+*/
+bool thread_table::collect_events() {
+  // Each thread is queued at most once per round, so that each one is
+  //   serviced before any of them is waited for again
+  int status;
+  pid_t tid;
+  while ((tid = waitpid(-1, &status, __WALL | WNOHANG)) > 0) {
+    queue_event(tid, status);
+  }
+  return tid == 0 || !events.empty();
+}
+
+/**
+* decode a waitpid status and queue the resulting event
+* @param tid    the thread waitpid reported
+* @param status the thread's status
+*/
+void thread_table::queue_event(pid_t tid, int status) {
+  thread_event event {};
+  event.tid = tid;
+
+  if (WIFEXITED(status) || WIFSIGNALED(status)) {
+    event.type = thread_event::EXITED;
+    threads.erase(tid);
+    events.push_back(event);
+    return;
+  }
+
+  // The initial SIGSTOP of a new thread can be reported before the clone
+  //   event of its parent, so threads are also added on their first stop
+  thread_info &thread = add(tid, thread_state::NEW);
+  int sig = WSTOPSIG(status);
+  int ptrace_event = status >> 16;
+
+  if (thread.state == thread_state::NEW && sig == SIGSTOP) {
+    event.type = thread_event::NEW_THREAD;
+  } else if (ptrace_event == PTRACE_EVENT_STOP) {
+    // Threads attached with PTRACE_SEIZE report their first stop this way,
+    //   as well as interrupts and group-stops
+    event.type = thread.state == thread_state::NEW ? thread_event::NEW_THREAD
+                 : thread_event::INTERRUPT;
+  } else if (sig == SIGTRAP && ptrace_event == PTRACE_EVENT_EXIT) {
+    event.type = thread_event::EXITING;
+  } else if (sig == SIGTRAP && (ptrace_event == PTRACE_EVENT_CLONE
+             || ptrace_event == PTRACE_EVENT_FORK || ptrace_event == PTRACE_EVENT_VFORK)) {
+    unsigned long msg;
+    ptrace(PTRACE_GETEVENTMSG, tid, NULL, &msg);
+    pid_t new_tid = msg;
+    event.type = thread_event::CLONED;
+    event.new_tid = new_tid;
+    thread.state = thread_state::STOPPED;
+    events.push_back(event);
+
+    // Wait for the new thread's initial stop right away, so that it always
+    //   follows the clone event. This keeps the order of events, and the
+    //   choices of the scheduler, independent of timing.
+    thread_info &created = add(new_tid, thread_state::NEW);
+    if (created.state == thread_state::NEW
+        && waitpid(new_tid, &status, __WALL) == new_tid) {
+      queue_event(new_tid, status);
+    }
+    return;
+  } else if (sig == SIGTRAP && ptrace_event != 0) {
+    event.type = thread_event::EVENT;
+  } else if (sig == SIGTRAP) {
+    event.type = thread_event::TRAP;
+  } else {
+    event.type = thread_event::SIGNAL;
+    event.sig = sig;
+  }
+  thread.state = thread_state::STOPPED;
+  events.push_back(event);
+}
@@ -0,0 +1,169 @@
+#ifndef _THREAD_TABLE_HH_
+#define _THREAD_TABLE_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+// What the tracer knows about a thread
+enum class thread_state {
+  NEW,     // Created, but its initial SIGSTOP was not seen yet
+  STOPPED, // Stopped, waiting to be resumed by the tracer
+  RUNNING  // Resumed by the tracer
+};
+
+// How a thread is advanced
+enum class step_mode {
+  INSTRUCTION, // Single-stepped one instruction at a time
+  LINE,        // Continued to its next source line
+  FREE         // Runs at full speed, e.g. until a watchpoint triggers
+};
+
+// A traced thread
+struct thread_info {
+  pid_t tid;                   // Thread ID
+  thread_state state;          // What the tracer knows about the thread
+  step_mode mode;              // How the thread is advanced
+  intptr_t last_ip;            // Instruction pointer at the last reported stop
+  size_t obj_hint;             // object_index slot of the last object found
+  intptr_t row_start;          // System memory range of the cached line row
+  intptr_t row_end;
+  const char* file;            // Source file of the cached row, nullptr if none
+  unsigned line;               // Source line of the cached row
+  intptr_t func_start;         // System memory range of the cached function
+  intptr_t func_end;
+  const char* function;        // Innermost function of the cached range, nullptr if none
+  const char* inlined_into;    // Function the cached one was inlined into, or nullptr
+  bool mid_step;               // Whether the thread was stopped before finishing its step
+  bool interrupted;            // Whether a SIGSTOP or PTRACE_INTERRUPT was sent to the
+                               //   thread and its stop not seen yet
+};
+
+// A decoded waitpid status
+struct thread_event {
+  enum kind {
+    EXITED,     // The thread exited or was killed
+    NEW_THREAD, // First stop of a new thread
+    TRAP,       // SIGTRAP: single-step, breakpoint or watchpoint
+    SIGNAL,     // Another signal, to be delivered to the thread
+    CLONED,     // The thread created another thread or process
+    INTERRUPT,  // Stopped by PTRACE_INTERRUPT, or a group-stop of a thread
+                //   attached with PTRACE_SEIZE
+    EXITING,    // The thread is about to exit, with PTRACE_O_TRACEEXIT. Its
+                //   process is still mapped.
+    EVENT       // Another ptrace event, such as exec
+  } type;
+  pid_t tid;     // The thread the event is about
+  int sig;       // Signal to deliver when resuming after a SIGNAL
+  pid_t new_tid; // The new thread, for CLONED
+};
+
+/**
+ * All the traced threads, and the queue of their pending events. Events are
+ *   collected in rounds: every thread that stopped since the last round is
+ *   queued once, in the order the kernel reported them, so that a thread
+ *   that keeps stopping cannot starve the others.
+ */
+class thread_table {
+public:
+
+  /**
+  * construct a new thread table. SIGCHLD is blocked in the tracer, so
+  *   that next_event() can wait for it with a timeout.
+  * @param mode how new threads are advanced
+  */
+  thread_table(step_mode mode);
+
+  /**
+  * add a thread, unless it is already known
+  * @param  tid   the thread
+  * @param  state the state of a thread that was not known
+  * @return       the thread's entry
+  */
+  thread_info& add(pid_t tid, thread_state state);
+
+  /**
+  * find a thread
+  * @param  tid the thread
+  * @return     the thread's entry, or nullptr if it is not known
+  */
+  thread_info* find(pid_t tid);
+
+  /**
+  * forget a thread that exited
+  * @param tid the thread
+  */
+  void erase(pid_t tid) { threads.erase(tid); }
+
+  /**
+  * forget the cached line row and function of every thread, e.g. once
+  *   libraries were unloaded and their addresses may be reused
+  */
+  void forget_lines();
+
+  /**
+  * @return the number of known threads
+  */
+  auto size() const -> size_t { return threads.size(); }
+
+  /**
+  * @return an iterator over the known threads, as (tid, entry) pairs
+  */
+  auto begin() -> std::unordered_map<pid_t, thread_info>::iterator { return threads.begin(); }
+
+  /**
+  * @return the end of the known threads
+  */
+  auto end() -> std::unordered_map<pid_t, thread_info>::iterator { return threads.end(); }
+
+  /**
+  * wait for the next thread event, and update the table accordingly
+  * @param  event      the decoded event
+  * @param  timeout_ms how long to wait for an event, or -1 to wait forever
+  * @return            1 if an event was returned, 0 if the timeout expired,
+  *                    -1 if no thread is left
+  */
+  int next_event(thread_event &event, int timeout_ms);
+
+  /**
+  * stop the running threads of a process other than one, e.g. while a
+  *   breakpoint is lifted to step that thread over it. A thread that
+  *   reports another event first keeps it queued and stays stopped; its
+  *   SIGSTOP is reported later, with interrupted set.
+  * @param pid    the process whose threads are stopped
+  * @param except the thread left alone
+  * @param paused set to the threads stopped by the SIGSTOP, to be
+  *               continued by resume_paused()
+  */
+  void pause_others(pid_t pid, pid_t except, std::vector<pid_t> &paused);
+
+  /**
+  * continue the threads stopped by pause_others()
+  * @param paused the stopped threads
+  */
+  void resume_paused(const std::vector<pid_t> &paused);
+
+private:
+  /**
+  * queue the events of every thread that is already stopped
+  * @return false if no thread is left, true otherwise
+  */
+  bool collect_events();
+
+  /**
+  * decode a waitpid status and queue the resulting event
+  * @param tid    the thread waitpid reported
+  * @param status the thread's status
+  */
+  void queue_event(pid_t tid, int status);
+
+  step_mode default_mode;                          // How new threads are advanced
+  std::unordered_map<pid_t, thread_info> threads;  // Traced threads
+  std::deque<thread_event> events;                 // Events of the current round
+};
+
+#endif /* _THREAD_TABLE_HH_ */
@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <stdexcept>
+
+#include "trace_file.hh"
+
+// Trace file header: magic, version and number of mappings, followed by each
+//   mapping's start, end, offset, path length and path
+static const char TRACE_MAGIC[8] = "PDBGTRC";
+static const uint32_t TRACE_VERSION = 2;
+
+// Record tags
+#define TAG_SMALL_LIMIT 0x80  // Tags below this are one-byte instructions
+#define TAG_INSTRUCTION 0x80
+#define TAG_THREAD      0x81
+#define TAG_EXIT        0x82
+#define TAG_MAP         0x83
+#define TAG_UNMAP       0x84
+
+// Longest path accepted in the header or in a mapping record
+#define MAX_PATH_LENGTH 4096
+
+// Size of the trace file buffers
+#define TRACE_FILE_BUFFER_SIZE (1 << 20)
+
+/**
+* create a trace file and write its header
+* @param file_path the path of the trace file
+* @param objects   the traced process' shared objects
+* @throws          std::invalid_argument if the file cannot be created
+*/
+trace_writer::trace_writer(const std::string &file_path, const std::vector<shared_obj> &objects)
+: written{0}, current{0}, current_ip{nullptr} {
+  out = fopen(file_path.c_str(), "we");
+  if (out == NULL) {
+    throw std::invalid_argument{"Cannot create trace file '" + file_path + "'"};
+  }
+  setvbuf(out, NULL, _IOFBF, TRACE_FILE_BUFFER_SIZE);
+
+  uint32_t count = objects.size();
+  fwrite(TRACE_MAGIC, sizeof(TRACE_MAGIC), 1, out);
+  fwrite(&TRACE_VERSION, sizeof(TRACE_VERSION), 1, out);
+  fwrite(&count, sizeof(count), 1, out);
+  written += sizeof(TRACE_MAGIC) + sizeof(TRACE_VERSION) + sizeof(count);
+
+  for (auto &obj : objects) {
+    uint64_t fields[3] = {(uint64_t)obj.get_start(), (uint64_t)obj.get_end(), obj.get_offset()};
+    std::string path = obj.get_path();
+    uint32_t len = path.size();
+    fwrite(fields, sizeof(fields), 1, out);
+    fwrite(&len, sizeof(len), 1, out);
+    fwrite(path.data(), 1, len, out);
+    written += sizeof(fields) + sizeof(len) + len;
+  }
+}
+
+trace_writer::~trace_writer() {
+  fclose(out);
+}
+
+/**
+* record an instruction executed by a thread
+* @param tid the thread
+* @param ip  the instruction address
+*/
+void trace_writer::record(pid_t tid, uint64_t ip) {
+  switch_thread(tid);
+
+  // Zigzag encode the delta, so that small negative deltas stay small
+  int64_t delta = ip - *current_ip;
+  uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+  *current_ip = ip;
+
+  if (zigzag < TAG_SMALL_LIMIT) {
+    putc_unlocked(zigzag, out);
+    written++;
+  } else {
+    putc_unlocked(TAG_INSTRUCTION, out);
+    written++;
+    write_varint(zigzag);
+  }
+}
+
+/**
+* record the exit of a thread
+* @param tid the thread
+*/
+void trace_writer::thread_exit(pid_t tid) {
+  putc_unlocked(TAG_EXIT, out);
+  written++;
+  write_varint(tid);
+
+  last_ips.erase(tid);
+  if (tid == current) {
+    current = 0;
+    current_ip = nullptr;
+  }
+}
+
+/**
+* record an object mapped after the header was written
+* @param obj the shared object
+*/
+void trace_writer::map(const shared_obj &obj) {
+  std::string path = obj.get_path();
+  putc_unlocked(TAG_MAP, out);
+  written++;
+  write_varint(obj.get_start());
+  write_varint(obj.get_end());
+  write_varint(obj.get_offset());
+  write_varint(path.size());
+  fwrite(path.data(), 1, path.size(), out);
+  written += path.size();
+}
+
+/**
+* record an object unmapped
+* @param obj the shared object
+*/
+void trace_writer::unmap(const shared_obj &obj) {
+  putc_unlocked(TAG_UNMAP, out);
+  written++;
+  write_varint(obj.get_start());
+  write_varint(obj.get_end());
+}
+
+/**
+* write an unsigned LEB128 varint
+* @param value the value to write
+*/
+void trace_writer::write_varint(uint64_t value) {
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    if (value != 0) {
+      byte |= 0x80;
+    }
+    putc_unlocked(byte, out);
+    written++;
+  } while (value != 0);
+}
+
+/**
+* switch the record stream to a thread, if it is not the current one
+* @param tid the thread
+*/
+void trace_writer::switch_thread(pid_t tid) {
+  if (tid == current && current_ip != nullptr) {
+    return;
+  }
+  putc_unlocked(TAG_THREAD, out);
+  written++;
+  write_varint(tid);
+  current = tid;
+  // Pointers to unordered_map values stay valid across insertions
+  current_ip = &last_ips[tid];
+}
+
+/**
+* open a trace file and read its header
+* @param file_path the path of the trace file
+* @throws          std::invalid_argument if the file cannot be opened or is
+*                  not a trace file
+*/
+trace_reader::trace_reader(const std::string &file_path)
+: current{0}, current_ip{nullptr} {
+  in = fopen(file_path.c_str(), "r");
+  if (in == NULL) {
+    throw std::invalid_argument{"Cannot open trace file '" + file_path + "'"};
+  }
+  setvbuf(in, NULL, _IOFBF, TRACE_FILE_BUFFER_SIZE);
+
+  char magic[8];
+  uint32_t version, count;
+  if (fread(magic, sizeof(magic), 1, in) != 1 || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0
+      || fread(&version, sizeof(version), 1, in) != 1 || version != TRACE_VERSION
+      || fread(&count, sizeof(count), 1, in) != 1) {
+    fclose(in);
+    throw std::invalid_argument{"Not a trace file '" + file_path + "'"};
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint64_t fields[3];
+    uint32_t len;
+    if (fread(fields, sizeof(fields), 1, in) != 1 || fread(&len, sizeof(len), 1, in) != 1) {
+      fclose(in);
+      throw std::invalid_argument{"Truncated trace file '" + file_path + "'"};
+    }
+    if (len > MAX_PATH_LENGTH) {
+      fclose(in);
+      throw std::invalid_argument{"Corrupt trace file '" + file_path + "'"};
+    }
+    trace_mapping entry;
+    entry.start = fields[0];
+    entry.end = fields[1];
+    entry.offset = fields[2];
+    entry.path.resize(len);
+    if (len > 0 && fread(&entry.path[0], 1, len, in) != len) {
+      fclose(in);
+      throw std::invalid_argument{"Truncated trace file '" + file_path + "'"};
+    }
+    mappings.push_back(entry);
+  }
+}
+
+trace_reader::~trace_reader() {
+  fclose(in);
+}
+
+/**
+* read the next record
+* @param  rec the decoded record
+* @return     true if a record was read, false at the end of the trace
+* @throws     std::runtime_error if the trace is truncated or malformed
+*/
+bool trace_reader::next(trace_record &rec) {
+  while (true) {
+    int tag = getc_unlocked(in);
+    if (tag == EOF) {
+      return false;
+    }
+
+    if (tag < TAG_SMALL_LIMIT || tag == TAG_INSTRUCTION) {
+      if (current_ip == nullptr) {
+        throw std::runtime_error{"Instruction record before any thread switch"};
+      }
+      uint64_t zigzag = tag < TAG_SMALL_LIMIT ? tag : read_varint();
+      int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+      *current_ip += delta;
+      rec.type = trace_record::INSTRUCTION;
+      rec.tid = current;
+      rec.ip = *current_ip;
+      return true;
+    } else if (tag == TAG_THREAD) {
+      current = read_varint();
+      current_ip = &last_ips[current];
+    } else if (tag == TAG_EXIT) {
+      rec.type = trace_record::EXIT;
+      rec.tid = read_varint();
+      rec.ip = 0;
+      last_ips.erase(rec.tid);
+      if (rec.tid == current) {
+        current = 0;
+        current_ip = nullptr;
+      }
+      return true;
+    } else if (tag == TAG_MAP) {
+      rec.type = trace_record::MAP;
+      rec.tid = 0;
+      rec.ip = 0;
+      read_range(mapping);
+      mapping.offset = read_varint();
+      uint64_t len = read_varint();
+      if (len > MAX_PATH_LENGTH) {
+        throw std::runtime_error{"Mapping path too long"};
+      }
+      mapping.path.resize(len);
+      if (len > 0 && fread(&mapping.path[0], 1, len, in) != len) {
+        throw std::runtime_error{"Truncated trace record"};
+      }
+      return true;
+    } else if (tag == TAG_UNMAP) {
+      rec.type = trace_record::UNMAP;
+      rec.tid = 0;
+      rec.ip = 0;
+      read_range(mapping);
+      mapping.offset = 0;
+      mapping.path.clear();
+      return true;
+    } else {
+      throw std::runtime_error{"Unknown trace record"};
+    }
+  }
+}
+
+/**
+* read an unsigned LEB128 varint
+* @return the value read
+* @throws std::runtime_error at the end of the file
+*/
+uint64_t trace_reader::read_varint() {
+  uint64_t value = 0;
+  int shift = 0;
+  int byte;
+  do {
+    byte = getc_unlocked(in);
+    if (byte == EOF || shift > 63) {
+      throw std::runtime_error{"Truncated trace record"};
+    }
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+/**
+* read the address range of a mapping record
+* @param mapping set to the address range
+* @throws        std::runtime_error at the end of the file
+*/
+void trace_reader::read_range(trace_mapping &mapping) {
+  mapping.start = read_varint();
+  mapping.end = read_varint();
+  if (mapping.end <= mapping.start) {
+    throw std::runtime_error{"Empty mapping"};
+  }
+}
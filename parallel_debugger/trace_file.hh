@@ -0,0 +1,172 @@
+#ifndef _TRACE_FILE_HH_
+#define _TRACE_FILE_HH_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "shared_object.hh"
+
+/**
+ * Binary execution traces. A trace file starts with a header holding the
+ *   traced process' mapped object table, followed by a stream of records:
+ *
+ *   0x00-0x7f  instruction of the current thread, whose address differs from
+ *              the thread's previous one by the zigzag-decoded byte value
+ *   0x80       instruction of the current thread, followed by the zigzag
+ *              varint address delta
+ *   0x81       thread switch, followed by the varint thread ID
+ *   0x82       thread exit, followed by the varint thread ID
+ *   0x83       object mapped, e.g. by dlopen, followed by the varint start,
+ *              end and offset, and the varint length of the path and the path
+ *   0x84       object unmapped, followed by the varint start and end
+ *
+ *   Address deltas are kept per thread, so most instructions take one byte.
+ */
+
+// A mapped object, as stored in a trace file header
+struct trace_mapping {
+  uint64_t start;   // Start address in system memory
+  uint64_t end;     // End address (exclusive) in system memory
+  uint64_t offset;  // File offset mapped at start
+  std::string path; // Absolute path of the mapped file
+};
+
+// A decoded trace record. It is also queued for each stop of a --workers
+//   run, so the object of a MAP or UNMAP record is kept by the reader.
+struct trace_record {
+  enum kind { INSTRUCTION, EXIT, MAP, UNMAP } type;
+  pid_t tid;   // Thread executing the instruction, or exiting
+  uint64_t ip; // Instruction address
+};
+
+class trace_writer {
+public:
+
+  /**
+  * create a trace file and write its header
+  * @param file_path the path of the trace file
+  * @param objects   the traced process' shared objects
+  * @throws          std::invalid_argument if the file cannot be created
+  */
+  trace_writer(const std::string &file_path, const std::vector<shared_obj> &objects);
+
+  ~trace_writer();
+
+  trace_writer(const trace_writer&) = delete;
+  trace_writer& operator=(const trace_writer&) = delete;
+
+  /**
+  * record an instruction executed by a thread
+  * @param tid the thread
+  * @param ip  the instruction address
+  */
+  void record(pid_t tid, uint64_t ip);
+
+  /**
+  * record the exit of a thread
+  * @param tid the thread
+  */
+  void thread_exit(pid_t tid);
+
+  /**
+  * record an object mapped after the header was written
+  * @param obj the shared object
+  */
+  void map(const shared_obj &obj);
+
+  /**
+  * record an object unmapped
+  * @param obj the shared object
+  */
+  void unmap(const shared_obj &obj);
+
+  /**
+  * @return the number of bytes written so far
+  */
+  auto bytes_written() const -> uint64_t { return written; }
+
+private:
+  /**
+  * write an unsigned LEB128 varint
+  * @param value the value to write
+  */
+  void write_varint(uint64_t value);
+
+  /**
+  * switch the record stream to a thread, if it is not the current one
+  * @param tid the thread
+  */
+  void switch_thread(pid_t tid);
+
+  FILE* out;                                     // The trace file
+  uint64_t written;                              // Bytes written so far
+  pid_t current;                                 // Thread of the following records
+  uint64_t* current_ip;                          // Last address of the current thread
+  std::unordered_map<pid_t, uint64_t> last_ips;  // Last address of each thread
+};
+
+class trace_reader {
+public:
+
+  /**
+  * open a trace file and read its header
+  * @param file_path the path of the trace file
+  * @throws          std::invalid_argument if the file cannot be opened or is
+  *                  not a trace file
+  */
+  trace_reader(const std::string &file_path);
+
+  ~trace_reader();
+
+  trace_reader(const trace_reader&) = delete;
+  trace_reader& operator=(const trace_reader&) = delete;
+
+  /**
+  * @return the objects mapped in the traced process when the trace started
+  */
+  auto get_mappings() const -> const std::vector<trace_mapping>& { return mappings; }
+
+  /**
+  * read the next record
+  * @param  rec the decoded record
+  * @return     true if a record was read, false at the end of the trace
+  * @throws     std::runtime_error if the trace is truncated or malformed
+  */
+  bool next(trace_record &rec);
+
+  /**
+  * @return the object mapped by the last MAP record, or the address range
+  *         unmapped by the last UNMAP record
+  */
+  auto get_mapping() const -> const trace_mapping& { return mapping; }
+
+private:
+  /**
+  * read an unsigned LEB128 varint
+  * @return the value read
+  * @throws std::runtime_error at the end of the file
+  */
+  uint64_t read_varint();
+
+  /**
+  * read the address range of a mapping record
+  * @param mapping set to the address range
+  * @throws        std::runtime_error at the end of the file
+  */
+  void read_range(trace_mapping &mapping);
+
+  FILE* in;                                      // The trace file
+  std::vector<trace_mapping> mappings;           // Mapped object table
+  trace_mapping mapping;                         // Object of the last MAP or UNMAP record
+  pid_t current;                                 // Thread of the following records
+  uint64_t* current_ip;                          // Last address of the current thread
+  std::unordered_map<pid_t, uint64_t> last_ips;  // Last address of each thread
+};
+
+#endif /* _TRACE_FILE_HH_ */
@@ -0,0 +1,227 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <system_error>
+#include <type_traits>
+
+#include "trace_pipeline.hh"
+
+// Bytes a worker formats before writing them out
+#define WORKER_FLUSH_SIZE (64 * 1024)
+
+// Empty polls after which a worker sleeps instead of yielding
+#define WORKER_SPIN_POLLS 64
+
+// How long an idle worker sleeps, in nanoseconds
+#define WORKER_SLEEP_NS 100000
+
+// Records are copied into and out of the rings at every stop
+static_assert(std::is_trivially_copyable<trace_record>::value,
+              "trace_record must stay trivially copyable");
+
+/**
+* start the worker threads
+* @param index   the address index of the traced process' shared objects.
+*                It must only change after drain().
+* @param out     the stream to print to
+* @param workers the number of worker threads
+* @throws        std::system_error if a worker's buffer cannot be created or
+*                its thread cannot be started
+*/
+trace_pipeline::trace_pipeline(object_index &index, FILE* out, unsigned workers)
+: index(index), out{out}, done{false}, lines{0}, finished{false} {
+  // The destructor does not run if this throws, so the workers started
+  //   and the buffers created so far are released here
+  try {
+    for (unsigned i = 0; i < workers; i++) {
+      worker *w = new worker{};
+      this->workers.emplace_back(w);
+      w->buffer = open_memstream(&w->data, &w->size);
+      if (w->buffer == NULL) {
+        throw std::system_error{errno, std::generic_category(), "Failed to create output buffer"};
+      }
+    }
+    // Started once every buffer exists, so that a failure to create one
+    //   throws before any thread runs
+    for (auto &w : this->workers) {
+      worker &ref = *w;
+      w->thread = std::thread([this, &ref]() { run(ref); });
+    }
+  } catch(...) {
+    release();
+    throw;
+  }
+}
+
+trace_pipeline::~trace_pipeline() {
+  release();
+}
+
+/**
+* stop the worker threads that were started, once they printed their queued
+*   stops, and free the buffers of all the workers
+*/
+void trace_pipeline::release() {
+  finished = true;
+  done.store(true, std::memory_order_release);
+  for (auto &w : workers) {
+    if (w->thread.joinable()) {
+      w->thread.join();
+    }
+    if (w->buffer != NULL) {
+      fclose(w->buffer);
+      w->buffer = NULL;
+    }
+    free(w->data);
+    w->data = NULL;
+  }
+}
+
+/**
+* queue a stop of a traced thread, waiting for room if its worker is behind
+* @param tid the stopped thread
+* @param rip the thread's instruction pointer
+*/
+void trace_pipeline::record(pid_t tid, intptr_t rip) {
+  push(trace_record{trace_record::INSTRUCTION, tid, (uint64_t)rip});
+}
+
+/**
+* queue the exit of a traced thread, so that its worker forgets it
+* @param tid the exited thread
+*/
+void trace_pipeline::thread_exit(pid_t tid) {
+  push(trace_record{trace_record::EXIT, tid, 0});
+}
+
+/**
+* wait until the workers handled every queued stop, so that the index can
+*   be changed
+*/
+void trace_pipeline::drain() {
+  for (auto &w : workers) {
+    while (w->handled.load(std::memory_order_acquire) < w->queued) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+/**
+* make the workers forget the cached line row and function of each thread,
+*   e.g. once libraries were unloaded. Only called after drain().
+*/
+void trace_pipeline::forget_lines() {
+  // The workers are idle, and only read their caches after popping a
+  //   record queued from now on
+  for (auto &w : workers) {
+    w->threads.clear();
+  }
+}
+
+/**
+* print every queued stop and stop the worker threads
+*/
+void trace_pipeline::finish() {
+  if (finished) {
+    return;
+  }
+  finished = true;
+  done.store(true, std::memory_order_release);
+  for (auto &w : workers) {
+    w->thread.join();
+  }
+}
+
+/**
+* queue a record for the worker of its thread
+* @param record the record
+*/
+void trace_pipeline::push(const trace_record &record) {
+  worker &w = *workers[record.tid % workers.size()];
+  while (!w.ring.push(record)) {
+    std::this_thread::yield();
+  }
+  w.queued++;
+}
+
+/**
+* print the queued stops of a worker until the pipeline finishes
+* @param w the worker
+*/
+void trace_pipeline::run(worker &w) {
+  unsigned long found = 0;
+  unsigned long handled = 0;
+  unsigned polls = 0;
+  trace_record record;
+  while (true) {
+    if (!w.ring.pop(record)) {
+      // The tracer is done once it says so and nothing is left
+      bool last = done.load(std::memory_order_acquire);
+      if (last && !w.ring.pop(record)) {
+        break;
+      }
+      if (!last) {
+        if (ftell(w.buffer) > 0) {
+          flush(w);
+        }
+        if (++polls < WORKER_SPIN_POLLS) {
+          std::this_thread::yield();
+        } else {
+          struct timespec pause = {0, WORKER_SLEEP_NS};
+          nanosleep(&pause, NULL);
+        }
+        continue;
+      }
+    }
+    polls = 0;
+
+    if (record.type == trace_record::EXIT) {
+      w.threads.erase(record.tid);
+      w.handled.store(++handled, std::memory_order_release);
+      continue;
+    }
+
+    // Each worker keeps the line cache of its own threads
+    auto it = w.threads.find(record.tid);
+    if (it == w.threads.end()) {
+      thread_info thread {};
+      thread.tid = record.tid;
+      it = w.threads.emplace(record.tid, thread).first;
+    }
+    thread_info &thread = it->second;
+    shared_obj *obj = index.find(record.ip, thread.obj_hint);
+    if (obj != nullptr) {
+      fprintf(w.buffer, "Thread ID (PID): %d | Instruction address: %lx\n", record.tid,
+              (unsigned long)record.ip);
+      if (print_thread_line(w.buffer, *obj, thread, record.ip)) {
+        found++;
+      }
+    }
+    if (ftell(w.buffer) >= WORKER_FLUSH_SIZE) {
+      flush(w);
+    }
+    // Published once the index is no longer used for the record
+    w.handled.store(++handled, std::memory_order_release);
+  }
+
+  flush(w);
+  lines += found;
+}
+
+/**
+* write out a worker's buffered output, and empty its buffer
+* @param w the worker
+*/
+void trace_pipeline::flush(worker &w) {
+  // Sets data and size to the text written since the buffer was last emptied
+  fflush(w.buffer);
+  {
+    std::lock_guard<std::mutex> guard(out_lock);
+    fwrite(w.data, 1, w.size, out);
+  }
+  rewind(w.buffer);
+}
@@ -0,0 +1,137 @@
+#ifndef _TRACE_PIPELINE_HH_
+#define _TRACE_PIPELINE_HH_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "object_index.hh"
+#include "spsc_ring.hh"
+#include "thread_table.hh"
+#include "trace_file.hh"
+
+// Stops queued per worker, at most
+#define TRACE_RING_SIZE (1 << 16)
+
+/**
+ * Symbolizes and prints the stops of a --trace run on worker threads, so
+ *   that the tracing thread only captures the thread and instruction
+ *   pointer of each stop before resuming the thread. Each traced thread is
+ *   assigned to one worker, which receives its stops through its own
+ *   single-producer, single-consumer ring. A traced thread's stops are thus
+ *   printed in order, while the stops of different threads may be printed
+ *   in a different order than they happened. Workers format into a private
+ *   buffer and write it out in large chunks.
+ */
+class trace_pipeline {
+public:
+
+  /**
+  * start the worker threads
+  * @param index   the address index of the traced process' shared objects.
+  *                It must only change after drain().
+  * @param out     the stream to print to
+  * @param workers the number of worker threads
+  * @throws        std::system_error if a worker's buffer cannot be created or
+  *                its thread cannot be started
+  */
+  trace_pipeline(object_index &index, FILE* out, unsigned workers);
+
+  ~trace_pipeline();
+
+  trace_pipeline(const trace_pipeline&) = delete;
+  trace_pipeline& operator=(const trace_pipeline&) = delete;
+
+  /**
+  * queue a stop of a traced thread, waiting for room if its worker is behind
+  * @param tid the stopped thread
+  * @param rip the thread's instruction pointer
+  */
+  void record(pid_t tid, intptr_t rip);
+
+  /**
+  * queue the exit of a traced thread, so that its worker forgets it
+  * @param tid the exited thread
+  */
+  void thread_exit(pid_t tid);
+
+  /**
+  * wait until the workers handled every queued stop, so that the index can
+  *   be changed
+  */
+  void drain();
+
+  /**
+  * make the workers forget the cached line row and function of each thread,
+  *   e.g. once libraries were unloaded. Only called after drain().
+  */
+  void forget_lines();
+
+  /**
+  * print every queued stop and stop the worker threads
+  */
+  void finish();
+
+  /**
+  * @return the number of printed stops with line information. Only complete
+  *         once finish() returned.
+  */
+  auto get_lines() const -> unsigned long { return lines.load(); }
+
+private:
+  // A worker thread, and the stops queued for it
+  struct worker {
+    worker() : ring{TRACE_RING_SIZE}, buffer{NULL}, data{NULL}, size{0}, queued{0}, handled{0} {}
+
+    spsc_ring<trace_record> ring;                   // Queued stops and exits
+    std::thread thread;                             // The worker thread
+    std::unordered_map<pid_t, thread_info> threads; // Cached line row of each thread
+    FILE* buffer;                                   // Output formatted by the worker
+    char* data;                                     // Contents of buffer, once flushed
+    size_t size;                                    // Size of data
+    unsigned long queued;                           // Records queued by the tracer
+    std::atomic<unsigned long> handled;             // Records handled by the worker
+  };
+
+  /**
+  * queue a record for the worker of its thread
+  * @param record the record
+  */
+  void push(const trace_record &record);
+
+  /**
+  * print the queued stops of a worker until the pipeline finishes
+  * @param w the worker
+  */
+  void run(worker &w);
+
+  /**
+  * stop the worker threads that were started, once they printed their queued
+  *   stops, and free the buffers of all the workers
+  */
+  void release();
+
+  /**
+  * write out a worker's buffered output, and empty its buffer
+  * @param w the worker
+  */
+  void flush(worker &w);
+
+  object_index &index;                          // Address index of the shared objects
+  FILE* out;                                    // Stream to print to
+  std::mutex out_lock;                          // Taken to write to out
+  std::vector<std::unique_ptr<worker>> workers; // The worker threads
+  std::atomic<bool> done;                       // Whether the tracer is done queuing
+  std::atomic<unsigned long> lines;             // Printed stops with line information
+  bool finished;                                // Whether finish() was called
+};
+
+#endif /* _TRACE_PIPELINE_HH_ */
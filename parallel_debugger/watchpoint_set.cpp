@@ -0,0 +1,115 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/user.h>
+
+#include "watchpoint_set.hh"
+
+// Offset of a debug register in struct user
+#define DEBUG_REG_OFFSET(i) (offsetof(struct user, u_debugreg) + (i) * sizeof(unsigned long))
+
+// DR6 and DR7 are the debug status and control registers
+#define DR_STATUS  6
+#define DR_CONTROL 7
+
+// DR7 condition bits: break on data writes, or on data reads or writes
+#define DR_RW_WRITE      0x1
+#define DR_RW_READ_WRITE 0x3
+
+/**
+* encode the length of a piece in DR7's length field
+* @param  len the length: 1, 2, 4 or 8
+* @return     the field's value
+*/
+static unsigned long encode_length(size_t len) {
+  switch (len) {
+    case 1:  return 0x0;
+    case 2:  return 0x1;
+    case 8:  return 0x2;
+    default: return 0x3;
+  }
+}
+
+/**
+* watch a range of memory. The range is split into naturally aligned
+*   pieces of 1, 2, 4 or 8 bytes, one debug register each.
+* @param  label a name for the location, used in reports
+* @param  addr  the first byte to watch
+* @param  size  the number of bytes to watch
+* @return       true if enough debug registers were free, false otherwise
+*/
+bool watchpoint_set::add(const std::string &label, intptr_t addr, size_t size) {
+  std::vector<debug_reg> pieces;
+  intptr_t pos = addr;
+  intptr_t end = addr + size;
+  while (pos < end) {
+    // Largest aligned piece starting at pos that does not pass the end
+    size_t len = 8;
+    while (len > 1 && ((pos & (len - 1)) != 0 || pos + (intptr_t)len > end)) {
+      len /= 2;
+    }
+    pieces.push_back(debug_reg{pos, len, watchpoints.size(), false});
+    if (split_writes) {
+      pieces.push_back(debug_reg{pos, len, watchpoints.size(), true});
+    }
+    pos += len;
+  }
+  if (pieces.empty() || regs.size() + pieces.size() > NUM_DEBUG_REGS) {
+    return false;
+  }
+
+  regs.insert(regs.end(), pieces.begin(), pieces.end());
+  watchpoints.push_back(watchpoint{label, addr, size});
+  return true;
+}
+
+/**
+* program the debug registers of a stopped thread
+* @param  tid the stopped thread
+* @return     true if the registers were accepted, false otherwise
+*/
+bool watchpoint_set::arm(pid_t tid) {
+  // The kernel checks the addresses against DR7, so set them first
+  unsigned long control = 0;
+  for (size_t i = 0; i < regs.size(); i++) {
+    if (ptrace(PTRACE_POKEUSER, tid, DEBUG_REG_OFFSET(i), regs[i].addr) == -1) {
+      return false;
+    }
+    control |= 1UL << (2 * i);  // Local enable
+    unsigned long condition = regs[i].write_only ? DR_RW_WRITE : DR_RW_READ_WRITE;
+    control |= (condition | encode_length(regs[i].len) << 2) << (16 + 4 * i);
+  }
+  return ptrace(PTRACE_POKEUSER, tid, DEBUG_REG_OFFSET(DR_CONTROL), control) != -1;
+}
+
+/**
+* check whether a stopped thread was stopped by a watchpoint, and reset its
+*   debug status register
+* @param  tid   the stopped thread
+* @param  write set to true if the access was a write. Always false unless
+*               writes are told apart.
+* @return       the index of the triggered watchpoint, or -1 if none was
+*/
+int watchpoint_set::hit(pid_t tid, bool &write) {
+  // A write triggers both registers of a split piece, a read only the first
+  unsigned long status = ptrace(PTRACE_PEEKUSER, tid, DEBUG_REG_OFFSET(DR_STATUS), NULL);
+  int watch = -1;
+  write = false;
+  for (size_t i = 0; i < regs.size(); i++) {
+    if (status & (1UL << i)) {
+      if (watch == -1) {
+        watch = regs[i].watch;
+      }
+      if (regs[i].write_only && (int)regs[i].watch == watch) {
+        write = true;
+      }
+    }
+  }
+  // The processor never clears DR6 by itself
+  if (watch != -1) {
+    ptrace(PTRACE_POKEUSER, tid, DEBUG_REG_OFFSET(DR_STATUS), 0);
+  }
+  return watch;
+}
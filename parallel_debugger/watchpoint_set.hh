@@ -0,0 +1,92 @@
+#ifndef _WATCHPOINT_SET_HH_
+#define _WATCHPOINT_SET_HH_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+// Number of x86 debug address registers (DR0-DR3)
+#define NUM_DEBUG_REGS 4
+
+// A watched location, which may use several debug registers
+struct watchpoint {
+  std::string label;  // Variable name or address given by the user
+  intptr_t addr;      // First watched byte
+  size_t size;        // Number of watched bytes
+};
+
+/**
+ * Hardware watchpoints, programmed into the x86 debug registers of every
+ *   traced thread. A thread stops right after an instruction reads or writes
+ *   a watched location. The debug registers are per thread and are not
+ *   inherited by new threads, so each thread must be armed once it is known.
+ *   Reads and writes trigger the same registers, unless writes are told
+ *   apart: each piece then also gets a write-only register, so half as many
+ *   bytes can be watched.
+ */
+class watchpoint_set {
+public:
+
+  /**
+  * construct a new, empty set of watchpoints
+  * @param split_writes whether hit() must tell writes from reads
+  */
+  watchpoint_set(bool split_writes)
+  : split_writes{split_writes}
+  {}
+
+  /**
+  * watch a range of memory. The range is split into naturally aligned
+  *   pieces of 1, 2, 4 or 8 bytes, one debug register each.
+  * @param  label a name for the location, used in reports
+  * @param  addr  the first byte to watch
+  * @param  size  the number of bytes to watch
+  * @return       true if enough debug registers were free, false otherwise
+  */
+  bool add(const std::string &label, intptr_t addr, size_t size);
+
+  /**
+  * program the debug registers of a stopped thread
+  * @param  tid the stopped thread
+  * @return     true if the registers were accepted, false otherwise
+  */
+  bool arm(pid_t tid);
+
+  /**
+  * check whether a stopped thread was stopped by a watchpoint, and reset its
+  *   debug status register
+  * @param  tid   the stopped thread
+  * @param  write set to true if the access was a write. Always false unless
+  *               writes are told apart.
+  * @return       the index of the triggered watchpoint, or -1 if none was
+  */
+  int hit(pid_t tid, bool &write);
+
+  /**
+  * @return the watched locations
+  */
+  auto get_watchpoints() const -> const std::vector<watchpoint>& { return watchpoints; }
+
+  /**
+  * @return true if nothing is watched
+  */
+  auto empty() const -> bool { return watchpoints.empty(); }
+
+private:
+  // A debug address register in use
+  struct debug_reg {
+    intptr_t addr;     // Aligned address of the piece
+    size_t len;        // Length of the piece: 1, 2, 4 or 8
+    size_t watch;      // Index of the watchpoint the piece belongs to
+    bool write_only;   // Whether only writes trigger the register
+  };
+
+  bool split_writes;                   // Whether writes are told from reads
+  std::vector<watchpoint> watchpoints; // Watched locations
+  std::vector<debug_reg> regs;         // Debug registers in use, DR0 first
+};
+
+#endif /* _WATCHPOINT_SET_HH_ */
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "debug_info.hh"
+#include "object_index.hh"
+#include "shared_object.hh"
+#include "trace_file.hh"
+
+using std::unordered_map;
+using std::vector;
+
+// Size of the output buffer
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+/**
+* Rebuilds the traced process' shared objects from a trace file's mapped
+*   object table. Files that cannot be parsed any more are skipped, so their
+*   instructions are reported without a file.
+* @param mappings the mapped object table
+* @param objects  a vector to store the shared objects
+* @param cache    the parsed files, shared by all their mappings
+*/
+void load_shared_objs(const vector<trace_mapping> &mappings, vector<shared_obj> &objects,
+                      debug_info_cache &cache) {
+  for (auto &mapping : mappings) {
+    // The trace does not record device and inode numbers, so files are only
+    //   told apart by path
+    auto info = cache.get(mapping.path, 0, 0);
+    if (info) {
+      objects.push_back(shared_obj (info, mapping.start, mapping.end, mapping.offset));
+    } else {
+      fprintf(stderr, "Cannot open '%s', its instructions will not be symbolized\n",
+              mapping.path.c_str());
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  /* Parse command line arguments */
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <binary trace file>\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  try {
+    trace_reader reader {argv[1]};
+
+    /* Rebuild the object table and its address index */
+    vector<shared_obj> shared_objs;
+    debug_info_cache debug_infos;
+    load_shared_objs(reader.get_mappings(), shared_objs, debug_infos);
+
+    /* Build the files' tables on worker threads, while the first records
+       are printed */
+    try {
+      debug_infos.preload(std::max(1u, std::thread::hardware_concurrency()));
+    } catch(std::system_error &e) {
+      // The tables are built on first use instead
+    }
+
+    object_index index;
+    index.build(shared_objs);
+
+    /* Slot of the last object found for each thread */
+    unordered_map<pid_t, size_t> last_hit;
+
+    /* Objects mapped while the program ran, by start address. The index
+       keeps pointers to them, which map nodes keep valid. */
+    std::map<uint64_t, shared_obj> mapped;
+
+    setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    /* Print each record in the debugger's text format */
+    trace_record rec;
+    const trace_mapping &mapping = reader.get_mapping();
+    while (reader.next(rec)) {
+      if (rec.type == trace_record::EXIT) {
+        last_hit.erase(rec.tid);
+        continue;
+      }
+      if (rec.type == trace_record::MAP) {
+        auto info = debug_infos.get(mapping.path, 0, 0);
+        if (!info) {
+          fprintf(stderr, "Cannot open '%s', its instructions will not be symbolized\n",
+                  mapping.path.c_str());
+          continue;
+        }
+        auto it = mapped.find(mapping.start);
+        if (it != mapped.end()) {
+          index.erase(&it->second);
+          mapped.erase(it);
+        }
+        it = mapped.emplace(mapping.start, shared_obj (info, mapping.start, mapping.end,
+                                                      mapping.offset)).first;
+        index.insert(&it->second);
+        continue;
+      }
+      if (rec.type == trace_record::UNMAP) {
+        auto it = mapped.find(mapping.start);
+        if (it != mapped.end() && (uint64_t)it->second.get_end() == mapping.end) {
+          index.erase(&it->second);
+          mapped.erase(it);
+        }
+        continue;
+      }
+
+      shared_obj *obj = index.find(rec.ip, last_hit[rec.tid]);
+      printf("Thread ID (PID): %d | Instruction address: %lx\n", rec.tid, (unsigned long)rec.ip);
+      if (obj != nullptr) {
+        print_line_info(stdout, *obj, rec.ip);
+      } else {
+        printf("No file mapped at this address.\n\n");
+      }
+    }
+  } catch(std::invalid_argument &e) {
+    fprintf(stderr, "%s\n", e.what());
+    exit(EXIT_FAILURE);
+  } catch(std::runtime_error &e) {
+    fflush(stdout);
+    fprintf(stderr, "Corrupt trace: %s\n", e.what());
+    exit(EXIT_FAILURE);
+  }
+
+  return 0;
+}